@@ -1,8 +1,13 @@
 #version 330 core
 
 // input data : sent from main program
-layout (location = 0) in vec3 vertexPosition;
-layout (location = 1) in vec3 vertexColor;
+layout (location = 0) in vec2 vertexPosition;
+layout (location = 1) in vec4 vertexColor; // RGBA8, normalized
+
+// per-instance data : offset (x,y) and rotation in radians, and color
+// non-instanced draws get the defaults set in initGL
+layout (location = 2) in vec3 instanceTransform;
+layout (location = 3) in vec3 instanceColor;
 
 uniform mat4 MVP;
 
@@ -11,11 +16,14 @@ out vec3 fragColor;
 
 void main ()
 {
-    vec4 v = vec4(vertexPosition, 1); // Transform an homogeneous 4D vector
+    float s = sin(instanceTransform.z);
+    float c = cos(instanceTransform.z);
+    vec2 p = mat2(c, s, -s, c) * vertexPosition + instanceTransform.xy;
+    vec4 v = vec4(p, 0, 1); // Transform an homogeneous 4D vector
 
     // The color of each vertex will be interpolated
     // to produce the color of each fragment
-    fragColor = vertexColor;
+    fragColor = vertexColor.rgb * instanceColor;
 
     // Output position of the vertex, in clip space : MVP * position
     gl_Position = MVP * v;
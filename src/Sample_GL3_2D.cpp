@@ -2,6 +2,11 @@
 #include <cmath>
 #include <fstream>
 #include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <algorithm>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -11,19 +16,236 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "sim.h"
+#include "inputlog.h"
+#include "jobs.h"
+#include "netplay.h"
+
 using namespace std;
 
+/* Interleaved vertex - 2D position plus normalized RGBA8 color, 12 bytes */
+struct Vertex {
+    GLfloat x, y;
+    GLubyte r, g, b, a;
+};
+
 struct VAO {
     GLuint VertexArrayID;
-    GLuint VertexBuffer;
-    GLuint ColorBuffer;
+    GLuint VertexBuffer; // interleaved Vertex data
 
     GLenum PrimitiveMode;
     GLenum FillMode;
+    int FirstVertex;
     int NumVertices;
+    GLsizeiptr BufferSize; // bytes in VertexBuffer
 };
 typedef struct VAO VAO;
 
+/* Last state handed to GL - binds and mode changes that would not change anything are skipped */
+struct GLStateCache {
+    GLuint program;
+    GLuint vertex_array;
+    GLuint array_buffer;
+    GLenum polygon_mode;
+    bool blend;
+
+    int issued;    // state calls sent to GL this frame
+    int skipped;   // redundant state calls dropped this frame
+    int last_issued, last_skipped; // totals of the previous frame
+} gl_state;
+
+/* Forget everything cached - for use after GL state was changed behind the cache's back */
+void invalidateGLState ()
+{
+    gl_state.program = ~0u;
+    gl_state.vertex_array = ~0u;
+    gl_state.array_buffer = ~0u;
+    gl_state.polygon_mode = GL_NONE;
+    glDisable(GL_BLEND);
+    gl_state.blend = 0;
+}
+
+void bindProgram (GLuint program)
+{
+    if(gl_state.program == program) {
+      gl_state.skipped++;
+      return;
+    }
+    glUseProgram(program);
+    gl_state.program = program;
+    gl_state.issued++;
+}
+
+void bindVertexArray (GLuint vertex_array)
+{
+    if(gl_state.vertex_array == vertex_array) {
+      gl_state.skipped++;
+      return;
+    }
+    glBindVertexArray(vertex_array);
+    gl_state.vertex_array = vertex_array;
+    gl_state.issued++;
+}
+
+void bindArrayBuffer (GLuint buffer)
+{
+    if(gl_state.array_buffer == buffer) {
+      gl_state.skipped++;
+      return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    gl_state.array_buffer = buffer;
+    gl_state.issued++;
+}
+
+void setPolygonMode (GLenum mode)
+{
+    if(gl_state.polygon_mode == mode) {
+      gl_state.skipped++;
+      return;
+    }
+    glPolygonMode(GL_FRONT_AND_BACK, mode);
+    gl_state.polygon_mode = mode;
+    gl_state.issued++;
+}
+
+void setBlend (bool blend)
+{
+    if(gl_state.blend == blend) {
+      gl_state.skipped++;
+      return;
+    }
+    if(blend)
+      glEnable(GL_BLEND);
+    else
+      glDisable(GL_BLEND);
+    gl_state.blend = blend;
+    gl_state.issued++;
+}
+
+/* Called once per frame - keeps the finished frame's counts for printGLState */
+void resetGLStateCounters ()
+{
+    gl_state.last_issued = gl_state.issued;
+    gl_state.last_skipped = gl_state.skipped;
+    gl_state.issued = 0;
+    gl_state.skipped = 0;
+}
+
+void printGLState ()
+{
+    printf("GL state calls last frame: %d issued, %d skipped\n", gl_state.last_issued, gl_state.last_skipped);
+}
+
+/* Every GL object is created and deleted through these so that leaks show up in the counts */
+struct GPUResources {
+    int vertex_arrays;
+    int buffers;
+    long buffer_bytes;
+    bool context_alive; // objects outliving glfwTerminate must not call GL
+} gpu_resources;
+
+GLuint genVertexArray ()
+{
+    GLuint id;
+    glGenVertexArrays(1, &id);
+    gpu_resources.vertex_arrays++;
+    return id;
+}
+
+void deleteVertexArray (GLuint id)
+{
+    if(gpu_resources.context_alive)
+      glDeleteVertexArrays(1, &id);
+    // Deleting the bound object binds 0 in its place
+    if(gl_state.vertex_array == id)
+      gl_state.vertex_array = 0;
+    gpu_resources.vertex_arrays--;
+}
+
+GLuint genBuffer ()
+{
+    GLuint id;
+    glGenBuffers(1, &id);
+    gpu_resources.buffers++;
+    return id;
+}
+
+void deleteBuffer (GLuint id, GLsizeiptr size)
+{
+    if(gpu_resources.context_alive)
+      glDeleteBuffers(1, &id);
+    if(gl_state.array_buffer == id)
+      gl_state.array_buffer = 0;
+    gpu_resources.buffers--;
+    gpu_resources.buffer_bytes -= size;
+}
+
+/* glBufferData on the bound buffer, accounting for the storage it replaces */
+void bufferData (GLenum target, GLsizeiptr old_size, GLsizeiptr size, const void* data, GLenum usage)
+{
+    glBufferData(target, size, data, usage);
+    gpu_resources.buffer_bytes += size - old_size;
+}
+
+void printGPUResources ()
+{
+    printf("GPU: %d vertex arrays, %d buffers, %ld bytes\n", gpu_resources.vertex_arrays, gpu_resources.buffers, gpu_resources.buffer_bytes);
+}
+
+/* Scratch memory for vertex and color uploads, reset once per frame.
+   Overflow blocks are folded into one block of the high-water size on reset,
+   so once a frame's worth of uploads fits nothing touches the heap */
+struct StagingBlock {
+    char* data;
+    size_t size;
+};
+
+struct StagingArena {
+    std::vector<StagingBlock> blocks; // current block is the last one
+    size_t used;                       // bytes used in the current block
+    size_t frame_used;                 // bytes handed out since the last reset
+    size_t high_water;
+} staging;
+
+/* Valid until the next stagingReset, 8-byte aligned */
+void* stagingAlloc (size_t count)
+{
+    count = (count + 7) & ~(size_t)7;
+    if(staging.blocks.empty() || staging.used + count > staging.blocks.back().size) {
+      StagingBlock block;
+      block.size = max(count, max(staging.high_water, (size_t)16384));
+      block.data = new char [block.size];
+      staging.blocks.push_back(block);
+      staging.used = 0;
+    }
+    char* data = staging.blocks.back().data + staging.used;
+    staging.used += count;
+    staging.frame_used += count;
+    return data;
+}
+
+void stagingReset ()
+{
+    staging.high_water = max(staging.high_water, staging.frame_used);
+    if(staging.blocks.size() > 1) {
+      for(size_t i=0;i<staging.blocks.size();i++)
+        delete [] staging.blocks[i].data;
+      staging.blocks.clear();
+      StagingBlock block;
+      block.size = staging.high_water;
+      block.data = new char [block.size];
+      staging.blocks.push_back(block);
+    }
+    staging.used = 0;
+    staging.frame_used = 0;
+}
+
+void printStaging ()
+{
+    printf("Staging: %lu bytes high-water, %lu blocks\n", (unsigned long)staging.high_water, (unsigned long)staging.blocks.size());
+}
+
 struct GLMatrices {
 	glm::mat4 projection;
 	glm::mat4 model;
@@ -31,7 +253,17 @@ struct GLMatrices {
 	GLuint MatrixID;
 } Matrices;
 
-GLuint programID;
+/* Shader programs - draw() picks one per entity type */
+enum ShaderType {
+    SHADER_DEFAULT,     // Sample_GL.vert/.frag - per-vertex color
+    SHADER_SDF_CIRCLE,  // Sample_SDF.vert/.frag - anti-aliased disc on a quad
+    SHADER_COUNT
+};
+
+struct ShaderProgram {
+    GLuint ProgramID;
+    GLuint MatrixID;
+} programs[SHADER_COUNT];
 
 /* Function to load Shaders - Use it as it is */
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
@@ -110,63 +342,107 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	return ProgramID;
 }
 
+/* Load a program into its slot and look up the uniforms every program shares */
+void loadProgram(int shader, const char * vertex_file_path,const char * fragment_file_path) {
+	programs[shader].ProgramID = LoadShaders(vertex_file_path, fragment_file_path);
+	programs[shader].MatrixID = glGetUniformLocation(programs[shader].ProgramID, "MVP");
+}
+
+/* Switch programs - MVP uploads after this go to the new program */
+void useProgram(int shader) {
+	bindProgram (programs[shader].ProgramID);
+	Matrices.MatrixID = programs[shader].MatrixID;
+}
+
 static void error_callback(int error, const char* description)
 {
     fprintf(stderr, "Error: %s\n", description);
 }
 
+void saveRecording ();
+void closeNetplay ();
+
 void quit(GLFWwindow *window)
 {
+    saveRecording();
+    closeNetplay();
+    gpu_resources.context_alive = 0;
     glfwDestroyWindow(window);
     glfwTerminate();
 //    exit(EXIT_SUCCESS);
 }
 
 
+GLubyte packColor (GLfloat c)
+{
+    if(c <= 0)
+      return 0;
+    if(c >= 1)
+      return 255;
+    return (GLubyte)(c*255 + 0.5f);
+}
+
+/* Interleave x,y,z positions (z is always 0 and dropped) and r,g,b colors into staging memory */
+struct Vertex* packVertices (int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data)
+{
+    struct Vertex* vertices = (struct Vertex*)stagingAlloc(numVertices*sizeof(struct Vertex));
+    for (int i=0; i<numVertices; i++) {
+        vertices[i].x = vertex_buffer_data[3*i];
+        vertices[i].y = vertex_buffer_data[3*i + 1];
+        vertices[i].r = packColor(color_buffer_data[3*i]);
+        vertices[i].g = packColor(color_buffer_data[3*i + 1]);
+        vertices[i].b = packColor(color_buffer_data[3*i + 2]);
+        vertices[i].a = 255;
+    }
+    return vertices;
+}
+
 /* Generate VAO, VBOs and return VAO handle */
 struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
 {
     struct VAO* vao = new struct VAO;
     vao->PrimitiveMode = primitive_mode;
+    vao->FirstVertex = 0;
     vao->NumVertices = numVertices;
     vao->FillMode = fill_mode;
+    vao->BufferSize = numVertices*sizeof(struct Vertex);
 
     // Create Vertex Array Object
     // Should be done after CreateWindow and before any other GL calls
-    glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
-    glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
-    glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
+    vao->VertexArrayID = genVertexArray(); // VAO
+    vao->VertexBuffer = genBuffer(); // VBO - interleaved vertices and colors
 
-    glBindVertexArray (vao->VertexArrayID); // Bind the VAO 
-    glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices 
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
+    bindVertexArray (vao->VertexArrayID); // Bind the VAO 
+    bindArrayBuffer (vao->VertexBuffer); // Bind the VBO vertices 
+    bufferData (GL_ARRAY_BUFFER, 0, vao->BufferSize, packVertices(numVertices, vertex_buffer_data, color_buffer_data), GL_STATIC_DRAW); // Copy the vertices into VBO
     glVertexAttribPointer(
                           0,                  // attribute 0. Vertices
-                          3,                  // size (x,y,z)
+                          2,                  // size (x,y)
                           GL_FLOAT,           // type
                           GL_FALSE,           // normalized?
-                          0,                  // stride
+                          sizeof(struct Vertex), // stride
                           (void*)0            // array buffer offset
                           );
-
-    glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors 
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
     glVertexAttribPointer(
                           1,                  // attribute 1. Color
-                          3,                  // size (r,g,b)
-                          GL_FLOAT,           // type
-                          GL_FALSE,           // normalized?
-                          0,                  // stride
-                          (void*)0            // array buffer offset
+                          4,                  // size (r,g,b,a)
+                          GL_UNSIGNED_BYTE,   // type
+                          GL_TRUE,            // normalized?
+                          sizeof(struct Vertex), // stride
+                          (void*)(2*sizeof(GLfloat)) // array buffer offset
                           );
 
+    // Attribute arrays are VAO state, so they only need enabling once
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
     return vao;
 }
 
 /* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
 struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL)
 {
-    GLfloat* color_buffer_data = new GLfloat [3*numVertices];
+    GLfloat* color_buffer_data = (GLfloat*)stagingAlloc(3*numVertices*sizeof(GLfloat));
     for (int i=0; i<numVertices; i++) {
         color_buffer_data [3*i] = red;
         color_buffer_data [3*i + 1] = green;
@@ -176,27 +452,458 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
     return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
 }
 
+/* Replace the contents of an existing VAO - same buffer objects, no new GL names */
+void update3DObject (struct VAO* vao, GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
+{
+    GLsizeiptr size = numVertices*sizeof(struct Vertex);
+    struct Vertex* vertices = packVertices(numVertices, vertex_buffer_data, color_buffer_data);
+    vao->PrimitiveMode = primitive_mode;
+    vao->NumVertices = numVertices;
+    vao->FillMode = fill_mode;
+
+    bindArrayBuffer (vao->VertexBuffer);
+    if(size == vao->BufferSize)
+      glBufferSubData (GL_ARRAY_BUFFER, 0, size, vertices);
+    else
+      bufferData (GL_ARRAY_BUFFER, vao->BufferSize, size, vertices, GL_STATIC_DRAW);
+
+    vao->BufferSize = size;
+}
+
+/* Free the VAO and its buffer */
+void delete3DObject (struct VAO* vao)
+{
+    deleteBuffer(vao->VertexBuffer, vao->BufferSize);
+    deleteVertexArray(vao->VertexArrayID);
+    delete vao;
+}
+
+/* Owns one VAO for its whole life - recreating an object reuses the buffers in place */
+class VAOHandle {
+   public:
+      VAOHandle () : vao(NULL) {}
+      ~VAOHandle () { this->release(); }
+
+      void create (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL) {
+        if(this->vao)
+          update3DObject(this->vao, primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+        else
+          this->vao = create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+      }
+
+      void release () {
+        if(this->vao)
+          delete3DObject(this->vao);
+        this->vao = NULL;
+      }
+
+      operator struct VAO* () const { return this->vao; }
+
+   private:
+      struct VAO* vao;
+
+      VAOHandle (const VAOHandle&);
+      VAOHandle& operator= (const VAOHandle&);
+};
+
 /* Render the VBOs handled by VAO */
 void draw3DObject (struct VAO* vao)
 {
     // Change the Fill Mode for this object
-    glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
+    setPolygonMode (vao->FillMode);
 
-    // Bind the VAO to use
-    glBindVertexArray (vao->VertexArrayID);
+    // Bind the VAO to use - it already holds the VBO and the enabled attributes
+    bindVertexArray (vao->VertexArrayID);
 
-    // Enable Vertex Attribute 0 - 3d Vertices
+    // Draw the geometry !
+    glDrawArrays(vao->PrimitiveMode, vao->FirstVertex, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+}
+
+/* Shared mesh drawn many times with one call - per-instance data is streamed each frame */
+struct InstanceBatch {
+    struct VAO* mesh;
+    GLuint VertexArrayID;   // the mesh's vertex buffer plus the instance attributes
+    GLuint InstanceBuffer;
+    int InstanceCapacity;
+    std::vector<GLfloat> instance_data; // x, y, rotation (radians), r, g, b per instance
+};
+
+/* Per-instance attributes for a shared mesh. The batch reads the mesh's vertices through a VAO
+   of its own, so the same mesh can still be drawn on its own with draw3DObject */
+struct InstanceBatch* createInstanceBatch (struct VAO* mesh)
+{
+    struct InstanceBatch* batch = new struct InstanceBatch;
+    batch->mesh = mesh;
+    batch->InstanceCapacity = 0;
+
+    batch->VertexArrayID = genVertexArray();
+    batch->InstanceBuffer = genBuffer(); // VBO - instances
+
+    bindVertexArray (batch->VertexArrayID);
+    bindArrayBuffer (mesh->VertexBuffer);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (void*)0);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(struct Vertex), (void*)(2*sizeof(GLfloat)));
     glEnableVertexAttribArray(0);
-    // Bind the VBO to use
-    glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
+    glEnableVertexAttribArray(1);
 
-    // Enable Vertex Attribute 1 - Color
+    bindArrayBuffer (batch->InstanceBuffer);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (void*)0); // attribute 2. Offset (x,y) and rotation
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (void*)(3*sizeof(GLfloat))); // attribute 3. Color
+    glVertexAttribDivisor(2, 1); // advance once per instance, not per vertex
+    glVertexAttribDivisor(3, 1);
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
+
+    return batch;
+}
+
+/* Queue one copy of the batch mesh, rotate_angle in degrees */
+void addInstance (struct InstanceBatch* batch, float x, float y, float rotate_angle, float red, float green, float blue)
+{
+    GLfloat instance [] = { x, y, (GLfloat)(rotate_angle*M_PI/180.0f), red, green, blue };
+    batch->instance_data.insert(batch->instance_data.end(), instance, instance+6);
+}
+
+/* Upload the queued instances and draw them all in one call */
+void drawInstanceBatch (struct InstanceBatch* batch)
+{
+    int numInstances = batch->instance_data.size()/6;
+    if(numInstances == 0)
+      return;
+
+    GLsizeiptr size = batch->instance_data.size()*sizeof(GLfloat);
+    bindArrayBuffer (batch->InstanceBuffer);
+    // Orphan the old storage so the driver does not stall on last frame's draw
+    int capacity = max(numInstances, batch->InstanceCapacity);
+    bufferData (GL_ARRAY_BUFFER, batch->InstanceCapacity*6*sizeof(GLfloat), capacity*6*sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+    batch->InstanceCapacity = capacity;
+    glBufferSubData (GL_ARRAY_BUFFER, 0, size, &batch->instance_data[0]);
+
+    setPolygonMode (batch->mesh->FillMode);
+    bindVertexArray (batch->VertexArrayID);
+    glDrawArraysInstanced(batch->mesh->PrimitiveMode, 0, batch->mesh->NumVertices, numInstances);
+
+    batch->instance_data.clear();
+}
+
+/* Draw order of the scene - lower layers are drawn first and end up underneath */
+enum RenderLayer {
+    LAYER_BRICKS,
+    LAYER_BASKETS,
+    LAYER_LASER,
+    LAYER_BULLETS,
+    LAYER_MIRRORS,
+    LAYER_HUD
+};
+
+/* One submitted draw - either a single mesh with its model matrix or a whole instance batch */
+struct RenderItem {
+    int layer;
+    int shader;
+    struct VAO* mesh;
+    struct InstanceBatch* batch; // NULL for single draws
+    glm::mat4 model;
+};
+
+/* Draws are collected during the frame and sorted so that items sharing program,
+   fill mode and mesh are drawn back to back with their state set once */
+struct RenderQueue {
+    std::vector<RenderItem> items;
+    bool depth_test;      // 2D scene relies on layer order, so this is normally off
+    bool depth_test_on;   // what GL currently has
+    int last_items, last_batches;
+} render_queue;
+
+void submit (struct VAO* mesh, const glm::mat4& model, int layer, int shader=SHADER_DEFAULT)
+{
+    RenderItem item;
+    item.layer = layer;
+    item.shader = shader;
+    item.mesh = mesh;
+    item.batch = NULL;
+    item.model = model;
+    render_queue.items.push_back(item);
+}
+
+/* Instances carry their own transforms, the batch is drawn with the view-projection alone */
+void submitInstances (struct InstanceBatch* batch, int layer, int shader=SHADER_DEFAULT)
+{
+    if(batch->instance_data.empty())
+      return;
+    RenderItem item;
+    item.layer = layer;
+    item.shader = shader;
+    item.mesh = batch->mesh;
+    item.batch = batch;
+    item.model = glm::mat4(1.0f);
+    render_queue.items.push_back(item);
+}
+
+bool renderItemBefore (const RenderItem& a, const RenderItem& b)
+{
+    if(a.layer != b.layer)
+      return a.layer < b.layer;
+    if(a.shader != b.shader)
+      return a.shader < b.shader;
+    if(a.mesh->FillMode != b.mesh->FillMode)
+      return a.mesh->FillMode < b.mesh->FillMode;
+    return a.mesh->VertexArrayID < b.mesh->VertexArrayID;
+}
+
+void flushRenderQueue (const glm::mat4& VP)
+{
+    std::vector<RenderItem>& items = render_queue.items;
+    std::stable_sort(items.begin(), items.end(), renderItemBefore);
+
+    if(render_queue.depth_test != render_queue.depth_test_on) {
+      if(render_queue.depth_test)
+        glEnable(GL_DEPTH_TEST);
+      else
+        glDisable(GL_DEPTH_TEST);
+      render_queue.depth_test_on = render_queue.depth_test;
+    }
+
+    int batches = 0;
+    for(size_t i=0;i<items.size();i++) {
+      RenderItem& item = items[i];
+      bool new_batch = (i == 0 || item.shader != items[i-1].shader || item.mesh != items[i-1].mesh || item.batch != items[i-1].batch);
+      if(new_batch) {
+        useProgram(item.shader);
+        setBlend(item.shader == SHADER_SDF_CIRCLE); // soft disc edge is in the alpha channel
+        setPolygonMode(item.mesh->FillMode);
+        bindVertexArray(item.batch ? item.batch->VertexArrayID : item.mesh->VertexArrayID);
+        batches++;
+      }
+
+      glm::mat4 MVP = VP * item.model;
+      glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+      if(item.batch)
+        drawInstanceBatch(item.batch);
+      else
+        glDrawArrays(item.mesh->PrimitiveMode, item.mesh->FirstVertex, item.mesh->NumVertices);
+    }
+
+    render_queue.last_items = items.size();
+    render_queue.last_batches = batches;
+    items.clear();
+}
+
+void printRenderQueue ()
+{
+    printf("Render queue last frame: %d items in %d batches\n", render_queue.last_items, render_queue.last_batches);
+}
+
+/* World-space vertices of every moving entity, rewritten by the CPU each frame and drawn
+   with one call per layer. The buffer is a ring of STREAM_SEGMENTS frame-sized segments and a
+   fence per segment keeps the CPU from overwriting vertices the GPU has not drawn yet */
+#define STREAM_SEGMENTS 3
+
+struct StreamBuffer {
+    struct VAO* vao;          // owns the ring - views[] are what get drawn
+    int capacity;             // vertices per segment
+    int segment;              // segment being written this frame
+    GLsync fences[STREAM_SEGMENTS];
+    bool persistent;          // mapped once for its whole life (GL 4.4 / ARB_buffer_storage)
+    struct Vertex* mapped;    // the whole ring, when persistent
+    struct Vertex* write;     // this frame's segment
+    int count;                // vertices written this frame
+    int queued;               // of those, already queued at a layer
+    struct VAO views[LAYER_HUD]; // copies of vao, FirstVertex and NumVertices set to one layer's run in this frame's segment
+    bool overflow;            // a frame did not fit, grow before the next one
+} stream;
+
+void createStreamBuffer (int capacity)
+{
+    GLsizeiptr size = (GLsizeiptr)capacity*STREAM_SEGMENTS*sizeof(struct Vertex);
+
+    struct VAO* vao = new struct VAO;
+    vao->PrimitiveMode = GL_TRIANGLES;
+    vao->FillMode = GL_FILL;
+    vao->FirstVertex = 0;
+    vao->NumVertices = 0;
+    vao->BufferSize = size;
+    vao->VertexArrayID = genVertexArray();
+    vao->VertexBuffer = genBuffer();
+
+    bindVertexArray (vao->VertexArrayID);
+    bindArrayBuffer (vao->VertexBuffer);
+
+    stream.persistent = GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+    if(stream.persistent) {
+      GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage (GL_ARRAY_BUFFER, size, NULL, flags);
+      gpu_resources.buffer_bytes += size;
+      stream.mapped = (struct Vertex*)glMapBufferRange (GL_ARRAY_BUFFER, 0, size, flags);
+    }
+    else {
+      bufferData (GL_ARRAY_BUFFER, 0, size, NULL, GL_STREAM_DRAW);
+      stream.mapped = NULL;
+    }
+
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (void*)0);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(struct Vertex), (void*)(2*sizeof(GLfloat)));
+    glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
-    // Bind the VBO to use
-    glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
 
-    // Draw the geometry !
-    glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+    stream.vao = vao;
+    stream.capacity = capacity;
+    stream.segment = 0;
+    for(int i=0;i<STREAM_SEGMENTS;i++)
+      stream.fences[i] = 0;
+    stream.write = NULL;
+    stream.count = 0;
+    stream.queued = 0;
+    stream.overflow = 0;
+}
+
+void deleteStreamBuffer ()
+{
+    for(int i=0;i<STREAM_SEGMENTS;i++) {
+      if(stream.fences[i]) {
+        glClientWaitSync(stream.fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        glDeleteSync(stream.fences[i]);
+      }
+    }
+    if(stream.persistent) {
+      bindArrayBuffer (stream.vao->VertexBuffer);
+      glUnmapBuffer (GL_ARRAY_BUFFER);
+    }
+    delete3DObject(stream.vao);
+    stream.vao = NULL;
+}
+
+/* Map the next segment - waits only if the GPU is still reading it from STREAM_SEGMENTS frames ago */
+void beginStream ()
+{
+    if(stream.overflow) {
+      int capacity = stream.capacity*2;
+      deleteStreamBuffer();
+      createStreamBuffer(capacity);
+    }
+
+    stream.segment = (stream.segment+1)%STREAM_SEGMENTS;
+    GLsync& fence = stream.fences[stream.segment];
+    if(fence) {
+      glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+      glDeleteSync(fence);
+      fence = 0;
+    }
+
+    if(stream.persistent)
+      stream.write = stream.mapped + stream.segment*stream.capacity;
+    else {
+      // The fence already guarantees the GPU is done with this range, so skip the driver's own sync
+      bindArrayBuffer (stream.vao->VertexBuffer);
+      stream.write = (struct Vertex*)glMapBufferRange (GL_ARRAY_BUFFER, stream.segment*stream.capacity*sizeof(struct Vertex),
+                                                       stream.capacity*sizeof(struct Vertex),
+                                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    }
+    stream.count = 0;
+    stream.queued = 0;
+}
+
+/* Room for n more vertices this frame, NULL (and a bigger ring next frame) when full */
+struct Vertex* streamReserve (int n)
+{
+    if(stream.count + n > stream.capacity) {
+      stream.overflow = 1;
+      return NULL;
+    }
+    struct Vertex* v = stream.write + stream.count;
+    stream.count += n;
+    return v;
+}
+
+void streamVertex (struct Vertex* v, float x, float y, GLubyte red, GLubyte green, GLubyte blue)
+{
+    v->x = x;
+    v->y = y;
+    v->r = red;
+    v->g = green;
+    v->b = blue;
+    v->a = 255;
+}
+
+/* Rectangle centred at x,y rotated by rotate_angle degrees */
+void streamQuad (float x, float y, float half_width, float half_length, float rotate_angle, GLubyte red, GLubyte green, GLubyte blue)
+{
+    struct Vertex* v = streamReserve(6);
+    if(!v)
+      return;
+    float c = cos(rotate_angle*M_PI/180.0f), s = sin(rotate_angle*M_PI/180.0f);
+    float ux = c*half_width, uy = s*half_width;     // half of the width axis
+    float vx = -s*half_length, vy = c*half_length;  // half of the length axis
+    streamVertex(v++, x-ux-vx, y-uy-vy, red, green, blue); // vertex 1
+    streamVertex(v++, x-ux+vx, y-uy+vy, red, green, blue); // vertex 2
+    streamVertex(v++, x+ux+vx, y+uy+vy, red, green, blue); // vertex 3
+
+    streamVertex(v++, x+ux+vx, y+uy+vy, red, green, blue); // vertex 3
+    streamVertex(v++, x+ux-vx, y+uy-vy, red, green, blue); // vertex 4
+    streamVertex(v++, x-ux-vx, y-uy-vy, red, green, blue); // vertex 1
+}
+
+void streamCircle (float x, float y, float radius, int parts, GLubyte red, GLubyte green, GLubyte blue)
+{
+    static std::vector<float> unit_circle; // cos, sin of each segment boundary
+    if((int)unit_circle.size() != 2*(parts+1)) {
+      unit_circle.resize(2*(parts+1));
+      for(int i=0;i<=parts;i++) {
+        unit_circle[2*i] = cos(2*M_PI*i/parts);
+        unit_circle[2*i+1] = sin(2*M_PI*i/parts);
+      }
+    }
+
+    struct Vertex* v = streamReserve(3*parts);
+    if(!v)
+      return;
+    for(int i=0;i<parts;i++) {
+      streamVertex(v++, x, y, red, green, blue);
+      streamVertex(v++, x+radius*unit_circle[2*i], y+radius*unit_circle[2*i+1], red, green, blue);
+      streamVertex(v++, x+radius*unit_circle[2*i+2], y+radius*unit_circle[2*i+3], red, green, blue);
+    }
+}
+
+/* Copy a prebuilt local-space shape moved to x,y */
+void streamVertices (const struct Vertex* shape, int n, float x, float y)
+{
+    struct Vertex* v = streamReserve(n);
+    if(!v)
+      return;
+    for(int i=0;i<n;i++) {
+      v[i] = shape[i];
+      v[i].x += x;
+      v[i].y += y;
+    }
+}
+
+/* Queue the vertices streamed since the last call as one item at layer, so the
+   streamed scene stacks up the same as the other paths */
+void streamLayer (int layer)
+{
+    if(stream.count == stream.queued)
+      return;
+    struct VAO& view = stream.views[layer];
+    view = *stream.vao;
+    view.FirstVertex = stream.segment*stream.capacity + stream.queued;
+    view.NumVertices = stream.count - stream.queued;
+    stream.queued = stream.count;
+    submit(&view, glm::mat4(1.0f), layer);
+}
+
+/* Done writing this frame's segment */
+void endStream ()
+{
+    if(!stream.persistent) {
+      bindArrayBuffer (stream.vao->VertexBuffer);
+      glUnmapBuffer (GL_ARRAY_BUFFER);
+    }
+    stream.write = NULL;
+}
+
+/* After the queue is flushed - marks when the GPU is done with this frame's segment */
+void fenceStream ()
+{
+    stream.fences[stream.segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 }
 
 double xpos, ypos;
@@ -211,62 +918,72 @@ float getMouseCoordY () {
   return (((height-ypos+4)/height*8)-4);
 }
 
-class Laser {
-   public:
-      float x;
-      float y;
-      float x_stick;
-      float y_stick;
-      float stick_width;
-      float stick_length;
-      float x_bullet;
-      float y_bullet;
-      float x_shift;
-      float y_shift;
-      float x_stick_shift;
-      float y_stick_shift;
-      float rotate_angle;
-      float x_shift_coord;
-      float y_shift_coord;
-      VAO *laserObj;
-      VAO *stickObj;
-      VAO *holeObj;
-
-      void moveUp() {
-        this->y+=0.07;
-        this->y_stick+=0.07;
-        this->y_shift+=0.07;
-        this->y_stick_shift+=0.07;
-      }
+/* Triangle fan around the origin as a GL_TRIANGLES list */
+struct VAO* createCircle (float radius, int parts)
+{
+  GLfloat* vertex_buffer_data_hole = (GLfloat*)stagingAlloc(parts*9*sizeof(GLfloat));
+  int i;
+  float angle=(2*M_PI/parts);
+  float current_angle = 0;
+  for(i=0;i<parts;i++){
+      vertex_buffer_data_hole[i*9]=0;
+      vertex_buffer_data_hole[i*9+1]=0;
+      vertex_buffer_data_hole[i*9+2]=0;
+      vertex_buffer_data_hole[i*9+3]=radius*cos(current_angle);
+      vertex_buffer_data_hole[i*9+4]=radius*sin(current_angle);
+      vertex_buffer_data_hole[i*9+5]=0;
+      vertex_buffer_data_hole[i*9+6]=radius*cos(current_angle+angle);
+      vertex_buffer_data_hole[i*9+7]=radius*sin(current_angle+angle);
+      vertex_buffer_data_hole[i*9+8]=0;
+      current_angle+=angle;
+  }
+  return create3DObject(GL_TRIANGLES, parts*3, vertex_buffer_data_hole, 1, 1, 1, GL_FILL);
+}
 
-      void moveDown() {
-        this->y+=-0.07;
-        this->y_stick+=-0.07;
-        this->y_shift+=-0.07;
-        this->y_stick_shift+=-0.07;
-      }
+/* Bullet geometry shared by every shot, one entry per tessellation level */
+struct CircleMesh {
+    struct VAO* mesh;             // drawn per object with draw3DObject
+    struct InstanceBatch* batch;  // same mesh, drawn instanced
+};
 
-      void stickMoveUp() {
-        if(this->rotate_angle<35.0) {
-          this->rotate_angle+=1.5;
-          if(this->rotate_angle>=0)
-            this->x_bullet = this->stick_width*(1 - cos(this->rotate_angle*M_PI/180.0f));
-          else
-            this->x_bullet = this->stick_width*(1 - cos(this->rotate_angle*M_PI/180.0f));
-          this->y_bullet = this->stick_length*sin(this->rotate_angle*M_PI/180.0f);
-        }
-      }
+std::map<int, CircleMesh> bullet_meshes;
 
-      void stickMoveDown() {
-        if(this->rotate_angle>-35.0) {
-          this->rotate_angle+=-1.5;
-          if(this->rotate_angle<=0)
-            this->x_bullet = this->stick_width*(1 - cos(this->rotate_angle*M_PI/180.0f));
-          else
-            this->x_bullet = this->stick_width*(1 - cos(this->rotate_angle*M_PI/180.0f));
-          this->y_bullet = this->stick_length*sin(this->rotate_angle*M_PI/180.0f);
-        }
-      }
+/* Unit quad for SHADER_SDF_CIRCLE - the disc edge is computed per fragment, so one size fits every zoom */
+CircleMesh sdf_bullet_mesh;
+
+int bullet_shader;
+
+/* Fewest segments (power of two) keeping the edge within a quarter pixel of a true circle */
+int circleSegments (float radius, float zoom)
+{
+  float radius_px = radius*fabs(zoom)*max(width, height)/8;
+  int parts = 8;
+  while(parts<256 && radius_px*(1-cos(M_PI/parts))>0.25)
+    parts*=2;
+  return parts;
+}
+
+/* Built once per zoom level that needs a new tessellation, never per shot */
+CircleMesh& getBulletMesh (float zoom)
+{
+  int parts = circleSegments(bullet_radius, zoom);
+  std::map<int, CircleMesh>::iterator it = bullet_meshes.find(parts);
+  if(it != bullet_meshes.end())
+    return it->second;
+
+  CircleMesh& circle = bullet_meshes[parts];
+  circle.mesh = createCircle(bullet_radius, parts);
+  circle.batch = createInstanceBatch(circle.mesh);
+  return circle;
+}
+
+/* GL meshes for the entities in sim.h - the Game says where, these say what */
+
+/* Laser body and stick - the body is baked at x=-4 and drawn translated by laser.y_shift */
+class LaserView {
+   public:
+      VAOHandle laserObj;
+      VAOHandle stickObj;
 
       void create () {
 
@@ -292,15 +1009,10 @@ class Laser {
           0,0.5,0.3  // color 1
         };
 
-        this->x = x_coord+x_shift;
-        this->y = y_coord+y_shift;
-        this->x_shift = x_shift;
-        this->y_shift = y_shift;
-
         // create3DObject creates and returns a handle to a VAO that can be used later
-        this->laserObj = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+        this->laserObj.create(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 
-        x_coord=0.3, y_coord=0.09, x_shift=-3.7, y_shift=0;
+        x_coord=0.3, y_coord=0.09;
 
         GLfloat vertex_buffer_data_stick [] = {
           -x_coord,-y_coord,0, // vertex 1
@@ -322,64 +1034,24 @@ class Laser {
           0.3,0,0.3  // color 1
         };
 
-        this->x_stick = x_coord+x_shift;
-        this->y_stick = y_coord+y_shift;
-        this->x_stick_shift = x_shift;
-        this->y_stick_shift = y_shift;
-        this->rotate_angle = 0;
-        this->stick_length = 2*y_coord;
-        this->stick_width = 2*x_coord;
-        this->x_bullet = 0;
-        this->y_bullet = 0;
-
-        // create3DObject creates and returns a handle to a VAO that can be used later
-        this->stickObj = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_stick, color_buffer_data_stick, GL_FILL);
-      }
-
-      void shoot() {
-
+        this->stickObj.create(GL_TRIANGLES, 6, vertex_buffer_data_stick, color_buffer_data_stick, GL_FILL);
       }
 };
 
-class Basket {
+/* Basket body and its two mouth flaps around the origin, drawn at the basket's x_shift, y_shift */
+class BasketView {
    public:
-      float x;
-      float y;
-      float x_shift;
-      float x_coord;
-      float y_coord;
-      float y_shift;
-      float width;
-      float length;
-      bool selected;
-      string color;
-      VAO *basketObj;
-      VAO *mouthObj1;
-      VAO *mouthObj2;
-
-     void moveLeft() {
-        this->x+=-0.4;
-        this->x_shift+=-0.4;
-      }
-
-      void followCursor () {
-        if(this->selected) {
-          this->x = getMouseCoordX() + (this->width)/2 + this->x_coord;
-          this->x_shift = getMouseCoordX() + (this->width)/2;
-        }
-      }
-
-      void moveRight() {
-        this->x+=0.4;
-        this->x_shift+=0.4;
-      }
+      VAOHandle basketObj;
+      VAOHandle mouthObj1;
+      VAOHandle mouthObj2;
+      struct Vertex shape[18]; // basketObj, mouthObj1, mouthObj2 in local space, for the streamed path
 
-      void create () {
+      void create (const Basket& basket) {
 
-        float x_coord=0.6, y_coord=0.6, x_shift=0, y_shift=0;
+        float x_coord=basket.x_coord, y_coord=basket.y_coord, x_shift=0, y_shift=0;
         int red=0, green=0, blue=0;
 
-        if(this->color == "red")
+        if(basket.color == COLOR_RED)
           red=1;
         else
           green=1;
@@ -404,24 +1076,9 @@ class Basket {
           red-0.8,green-0.8,blue  // color 1
         };
 
-        if(this->color == "red")
-          x_shift=-1.0;
-        else
-          x_shift=1.0;
-
-        this->x = x_coord+x_shift;
-        this->y = y_coord-3.4;
-        this->x_coord = x_coord;
-        this->y_coord = y_coord;
-        this->x_shift = x_shift;
-        this->y_shift = -3.4;
-        this->length = 2*y_coord;
-        this->width = 2*x_coord;
-        this->selected = 0;
-        x_shift=0;
-
         // create3DObject creates and returns a handle to a VAO that can be used later
-        this->basketObj = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_mouth1, color_buffer_data_mouth1, GL_FILL);
+        this->basketObj.create(GL_TRIANGLES, 6, vertex_buffer_data_mouth1, color_buffer_data_mouth1, GL_FILL);
+        memcpy(this->shape, packVertices(6, vertex_buffer_data_mouth1, color_buffer_data_mouth1), 6*sizeof(struct Vertex));
 
         red=1;
         green=1;
@@ -429,7 +1086,7 @@ class Basket {
         
         x_coord/=2;
         y_coord=0.02;
-        y_shift+=this->length/2;
+        y_shift+=basket.length/2;
         
         GLfloat vertex_buffer_data [] = {
           -x_coord+x_shift,-y_coord+y_shift,0, // vertex 1
@@ -451,7 +1108,8 @@ class Basket {
           red-0.5,green-0.5,blue-0.5, // color 1
         };
 
-        this->mouthObj1 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+        this->mouthObj1.create(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+        memcpy(this->shape+6, packVertices(6, vertex_buffer_data, color_buffer_data), 6*sizeof(struct Vertex));
         
         GLfloat vertex_buffer_data_mouth2 [] = {
           -x_coord+x_shift,-y_coord+y_shift-0.08,0, // vertex 1
@@ -473,672 +1131,196 @@ class Basket {
           red,green,blue  // color 1
         };
 
-        this->mouthObj2 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_mouth2, color_buffer_data_mouth2, GL_FILL);
+        this->mouthObj2.create(GL_TRIANGLES, 6, vertex_buffer_data_mouth2, color_buffer_data_mouth2, GL_FILL);
+        memcpy(this->shape+12, packVertices(6, vertex_buffer_data_mouth2, color_buffer_data_mouth2), 6*sizeof(struct Vertex));
       }
 };
 
-class Mirror {
-   public:
-      float x;
-      float y;
-      float x_shift;
-      float y_shift;
-      float width;
-      float length;
-      float rotate_angle;
-      VAO *mirrorObj;
-
-      void create (float x_shift, float y_shift, float rotate_angle) {
-
-        float x_coord=0.6, y_coord=0.01;
-        int red=0, green=0, blue=0;
-
-        GLfloat vertex_buffer_data [] = {
-          -x_coord,-y_coord,0, // vertex 1
-          -x_coord,y_coord,0, // vertex 2
-          x_coord,y_coord,0, // vertex 3
-
-          x_coord,y_coord,0, // vertex 3
-          x_coord,-y_coord,0, // vertex 4
-          -x_coord,-y_coord,0  // vertex 1
-        };
+/* Segment geometry shared by every digit on the HUD - a..g, built once by createSegments */
+VAO *segmentObj[7];
 
-        GLfloat color_buffer_data [] = {
-          red,green,blue, // color 1
-          red,green,blue, // color 2
-          red,green,blue, // color 3
+/* Lit segments for 0-9, bit 0 is segment a and bit 6 is segment g */
+const unsigned char digit_segments[10] = {
+  0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F
+};
 
-          red,green,blue, // color 3
-          red,green,blue, // color 4
-          red,green,blue  // color 1
-        };
+void createSegments () {
+  // x_shift, y_shift, x_coord, y_coord of each segment, relative to the digit centre
+  static const float layout[7][4] = {
+    { 0,     0.25,  0.09,  0.04 }, // a
+    { 0.11,  0.12,  0.025, 0.12 }, // b
+    { 0.11,  -0.12, 0.025, 0.12 }, // c
+    { 0,     -0.25, 0.09,  0.04 }, // d
+    { -0.11, -0.12, 0.025, 0.12 }, // e
+    { -0.11, 0.12,  0.025, 0.12 }, // f
+    { 0,     0,     0.09,  0.04 }  // g
+  };
 
-        this->x_shift = x_shift;
-        this->y_shift = y_shift;
-        this->length = 2*y_coord;
-        this->width = 2*x_coord;
-        this->rotate_angle = rotate_angle;
-        this->x = x_coord+x_shift-(this->width/2);
-        this->y = y_coord+y_shift;
+  for(int i=0;i<7;i++) {
+    float x_shift=layout[i][0], y_shift=layout[i][1], x_coord=layout[i][2], y_coord=layout[i][3];
 
-        // create3DObject creates and returns a handle to a VAO that can be used later
-        this->mirrorObj = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_LINE);
-      }
-};
+    GLfloat vertex_buffer_data [] = {
+      -x_coord+x_shift,-y_coord+y_shift,0, // vertex 1
+      -x_coord+x_shift,y_coord+y_shift,0, // vertex 2
+      x_coord+x_shift,y_coord+y_shift,0, // vertex 3
 
-class Bullet {
-   public:
-      float x;
-      float y;
-      float x_shift;
-      float y_shift;
-      float vector_translate;
-      float rotate_angle;
-      float radius;
-      float x_laser_shift;
-      float y_laser_shift;
-      bool status;
-      bool reflected;
-      VAO *bulletObj;
-
-      void create(float rotate_angle) {
-        int parts = 1000;
-        float radius = 0.09;
-        this->radius = radius;
-        GLfloat vertex_buffer_data_hole[parts*9];
-        GLfloat color_buffer_data_hole[parts*9];
-        int i,j;
-        float angle=(2*M_PI/parts);
-        float current_angle = 0;
-        for(i=0;i<parts;i++){
-            for(j=0;j<3;j++){
-                color_buffer_data_hole[i*9+j*3]=1;
-                color_buffer_data_hole[i*9+j*3+1]=1;
-                color_buffer_data_hole[i*9+j*3+2]=1;
-            }
-            vertex_buffer_data_hole[i*9]=0;
-            vertex_buffer_data_hole[i*9+1]=0;
-            vertex_buffer_data_hole[i*9+2]=0;
-            vertex_buffer_data_hole[i*9+3]=radius*cos(current_angle);
-            vertex_buffer_data_hole[i*9+4]=radius*sin(current_angle);
-            vertex_buffer_data_hole[i*9+5]=0;
-            vertex_buffer_data_hole[i*9+6]=radius*cos(current_angle+angle);
-            vertex_buffer_data_hole[i*9+7]=radius*sin(current_angle+angle);
-            vertex_buffer_data_hole[i*9+8]=0;
-            current_angle+=angle;
-        }
-        this->rotate_angle=rotate_angle;
-        this->vector_translate=0;
-        this->status = 1;
-        this->reflected = 0;
-        this->bulletObj = create3DObject(GL_TRIANGLES, (parts*9)/3, vertex_buffer_data_hole, color_buffer_data_hole, GL_FILL);
-      }
-};
+      x_coord+x_shift,y_coord+y_shift,0, // vertex 3
+      x_coord+x_shift,-y_coord+y_shift,0, // vertex 4
+      -x_coord+x_shift,-y_coord+y_shift,0  // vertex 1
+    };
 
-float randomFloat(float min, float max)
-{
-  float r = (float)rand() / (float)RAND_MAX;
-  return min + r * (max - min);
+    segmentObj[i] = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, 0.5, 0, 0, GL_FILL);
+  }
 }
 
-class Brick {
+class SevenSegment {
    public:
-      float x;
-      float y;
+      float x_shift;
       float y_shift;
-      float length;
-      float width;
-      bool status;
-      string color;
-      VAO *brickObj;
-
-      void moveDown() {
-        this->y+=-0.07;
-      }
-
-      void vanish() {
-        this->y_shift+=3000;
-        this->y+=3000;
-        this->status=0;
-      }
-
-      void create (float x_shift) {
-
-        float x_coord=0.08, y_coord=0.15, y_shift=3.5;
-
-        int color=(rand()%3), red=0, green=0, blue=0;
-        switch(color){
-          case 0:
-            red=1;
-            this->color="red";
-            break; //optional
-          case 1:
-            green=1;
-            this->color="green";
-            break; //optional
-          case 2:
-            this->color="black";
-            break; //optional
-        }
-
-        GLfloat vertex_buffer_data [] = {
-          -x_coord+x_shift,-y_coord+y_shift,0, // vertex 1
-          -x_coord+x_shift,y_coord+y_shift,0, // vertex 2
-          x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-
-          x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-          x_coord+x_shift,-y_coord+y_shift,0, // vertex 4
-          -x_coord+x_shift,-y_coord+y_shift,0  // vertex 1
-        };
-
-        GLfloat color_buffer_data [] = {
-          red,green,blue, // color 1
-          red,green,blue, // color 2
-          red,green,blue, // color 3
+      unsigned char segments;
 
-          red,green,blue, // color 3
-          red,green,blue, // color 4
-          red,green,blue  // color 1
-        };
-
-        this->x = x_coord+x_shift;
-        this->y = y_coord+y_shift;
-        this->y_shift = 0;
-        this->length = 2*y_coord;
-        this->width = 2*x_coord;
-        this->status = 1;
-
-        // create3DObject creates and returns a handle to a VAO that can be used later
-        this->brickObj = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+      void create (float X_SHIFT, float Y_SHIFT, int number) {
+        this->x_shift = X_SHIFT;
+        this->y_shift = Y_SHIFT;
+        this->segments = digit_segments[number];
       }
 };
 
-class SevenSegment {
+/* A number on the HUD - the ones digit sits at x_shift and higher digits grow to the left */
+class SevenSegmentDisplay {
    public:
-      float x;
-      float y;
-      float y_shift;
       float x_shift;
-      float length;
-      float width;
-      VAO *a, *b, *c, *d, *e, *f, *g;
-      bool A, B, C, D, E, F, G;
-
-      void create (float X_SHIFT, float Y_SHIFT, int number) {
+      float y_shift;
+      int min_digits;
+      int value;
+      std::vector<SevenSegment> digits;
 
+      void create (float X_SHIFT, float Y_SHIFT, int min_digits) {
         this->x_shift = X_SHIFT;
         this->y_shift = Y_SHIFT;
-        this->A=1; this->B=1; this->C=1; this->D=1; this->E=1; this->F=1; this->G=1;
-
-        float x_coord, y_coord, red=0.5, blue=0, green=0, x_shift, y_shift;
+        this->min_digits = min_digits;
+        this->value = -1;
+        this->digits.clear();
+      }
 
-        if(number > 10 || number < 0 ) 
+      // Only recomputes the lit segments when the value changes, no GL work
+      void update (int number) {
+        if(number < 0)
+          number = 0;
+        if(number == this->value)
           return;
-
-        switch(number){
-          case 0:
-            this->G=0;
-            break; //optional
-          case 1:
-            this->G=0;
-            this->F=0;
-            this->E=0;
-            this->A=0;
-            this->D=0;
-            break; //optional
-          case 2:
-            this->F=0;
-            this->C=0;
-            break; //optional
-          case 3:
-            this->F=0;
-            this->E=0;
-            break; //optional
-          case 4:
-            this->A=0;
-            this->E=0;
-            this->D=0;
-            break; //optional
-          case 5:
-            this->B=0;
-            this->E=0;
-            break; //optional
-          case 6:
-            this->B=0;
-            break; //optional
-          case 7:
-            this->G=0;
-            this->E=0;
-            this->F=0;
-            this->D=0;
-            break; //optional
-          case 8:
-            break; //optional
-          case 9:
-            this->E=0;
-            break; //optional
-        }
-        
-        if(this->G) {
-          y_shift = 0, x_coord=0.09, y_coord=0.04, x_shift=0;
-
-          GLfloat vertex_buffer_data_g [] = {
-            -x_coord+x_shift,-y_coord+y_shift,0, // vertex 1
-            -x_coord+x_shift,y_coord+y_shift,0, // vertex 2
-            x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-
-            x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-            x_coord+x_shift,-y_coord+y_shift,0, // vertex 4
-            -x_coord+x_shift,-y_coord+y_shift,0  // vertex 1
-          };
-
-          GLfloat color_buffer_data_g [] = {
-            red,green,blue, // color 1
-            red,green,blue, // color 2
-            red,green,blue, // color 3
-
-            red,green,blue, // color 3
-            red,green,blue, // color 4
-            red,green,blue  // color 1
-          };
-
-          G = 1;
-          this->g = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_g, color_buffer_data_g, GL_FILL);
-        }
-
-        if(this->A) {
-          y_shift = 0.25, x_coord=0.09, y_coord=0.04, x_shift=0;
-
-          GLfloat vertex_buffer_data_a [] = {
-            -x_coord+x_shift,-y_coord+y_shift,0, // vertex 1
-            -x_coord+x_shift,y_coord+y_shift,0, // vertex 2
-            x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-
-            x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-            x_coord+x_shift,-y_coord+y_shift,0, // vertex 4
-            -x_coord+x_shift,-y_coord+y_shift,0  // vertex 1
-          };
-
-          GLfloat color_buffer_data_a [] = {
-            red,green,blue, // color 1
-            red,green,blue, // color 2
-            red,green,blue, // color 3
-
-            red,green,blue, // color 3
-            red,green,blue, // color 4
-            red,green,blue  // color 1
-          };
-
-          A = 1;
-          this->a = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_a, color_buffer_data_a, GL_FILL);
-        }
-
-        if(this->D) {
-          x_coord=0.09, y_coord=0.04, x_shift=0, y_shift = -0.25;
-
-          GLfloat vertex_buffer_data_d [] = {
-            -x_coord+x_shift,-y_coord+y_shift,0, // vertex 1
-            -x_coord+x_shift,y_coord+y_shift,0, // vertex 2
-            x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-
-            x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-            x_coord+x_shift,-y_coord+y_shift,0, // vertex 4
-            -x_coord+x_shift,-y_coord+y_shift,0  // vertex 1
-          };
-
-          GLfloat color_buffer_data_d [] = {
-            red,green,blue, // color 1
-            red,green,blue, // color 2
-            red,green,blue, // color 3
-
-            red,green,blue, // color 3
-            red,green,blue, // color 4
-            red,green,blue  // color 1
-          };
-
-          D = 1;
-          this->d = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_d, color_buffer_data_d, GL_FILL);
-        }
-
-        if(this->C) {
-          x_shift = 0.11, x_coord=0.025, y_coord=0.12, y_shift=-0.12;
-
-          GLfloat vertex_buffer_data_c [] = {
-            -x_coord+x_shift,-y_coord+y_shift,0, // vertex 1
-            -x_coord+x_shift,y_coord+y_shift,0, // vertex 2
-            x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-
-            x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-            x_coord+x_shift,-y_coord+y_shift,0, // vertex 4
-            -x_coord+x_shift,-y_coord+y_shift,0  // vertex 1
-          };
-
-          GLfloat color_buffer_data_c [] = {
-            red,green,blue, // color 1
-            red,green,blue, // color 2
-            red,green,blue, // color 3
-
-            red,green,blue, // color 3
-            red,green,blue, // color 4
-            red,green,blue  // color 1
-          };
-
-          C = 1;
-          this->c = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_c, color_buffer_data_c, GL_FILL);
-        }
-
-        
-        if(this->B) {
-          x_shift = 0.11, x_coord=0.025, y_coord=0.12, y_shift=0.12;
-
-          GLfloat vertex_buffer_data_b [] = {
-            -x_coord+x_shift,-y_coord+y_shift,0, // vertex 1
-            -x_coord+x_shift,y_coord+y_shift,0, // vertex 2
-            x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-
-            x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-            x_coord+x_shift,-y_coord+y_shift,0, // vertex 4
-            -x_coord+x_shift,-y_coord+y_shift,0  // vertex 1
-          };
-
-          GLfloat color_buffer_data_b [] = {
-            red,green,blue, // color 1
-            red,green,blue, // color 2
-            red,green,blue, // color 3
-
-            red,green,blue, // color 3
-            red,green,blue, // color 4
-            red,green,blue  // color 1
-          };
-
-          B = 1;
-          this->b = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_b, color_buffer_data_b, GL_FILL);
-        }
-
-        if(this->E) {
-          x_shift = -0.11, x_coord=0.025, y_coord=0.12, y_shift=-0.12;
-
-          GLfloat vertex_buffer_data_e [] = {
-            -x_coord+x_shift,-y_coord+y_shift,0, // vertex 1
-            -x_coord+x_shift,y_coord+y_shift,0, // vertex 2
-            x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-
-            x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-            x_coord+x_shift,-y_coord+y_shift,0, // vertex 4
-            -x_coord+x_shift,-y_coord+y_shift,0  // vertex 1
-          };
-
-          GLfloat color_buffer_data_e [] = {
-            red,green,blue, // color 1
-            red,green,blue, // color 2
-            red,green,blue, // color 3
-
-            red,green,blue, // color 3
-            red,green,blue, // color 4
-            red,green,blue  // color 1
-          };
-
-          E = 1;
-          this->e = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_e, color_buffer_data_e, GL_FILL);
-        }
-
-        if(this->F) {
-          x_shift = -0.11, x_coord=0.025, y_coord=0.12, y_shift=0.12;
-
-          GLfloat vertex_buffer_data_f [] = {
-            -x_coord+x_shift,-y_coord+y_shift,0, // vertex 1
-            -x_coord+x_shift,y_coord+y_shift,0, // vertex 2
-            x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-
-            x_coord+x_shift,y_coord+y_shift,0, // vertex 3
-            x_coord+x_shift,-y_coord+y_shift,0, // vertex 4
-            -x_coord+x_shift,-y_coord+y_shift,0  // vertex 1
-          };
-
-          GLfloat color_buffer_data_f [] = {
-            red,green,blue, // color 1
-            red,green,blue, // color 2
-            red,green,blue, // color 3
-
-            red,green,blue, // color 3
-            red,green,blue, // color 4
-            red,green,blue  // color 1
-          };
-
-          F = 1;
-          this->f = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_f, color_buffer_data_f, GL_FILL);
-        }
+        this->value = number;
+
+        int i = 0;
+        do {
+          if(i == (int)this->digits.size())
+            this->digits.push_back(SevenSegment());
+          this->digits[i].create(this->x_shift - 0.3*i, this->y_shift, number%10);
+          number /= 10;
+          i++;
+        } while(number > 0 || i < this->min_digits);
+        this->digits.resize(i);
       }
 };
 
-Laser laser;
+SevenSegmentDisplay score_display, clock_display;
 
-SevenSegment score_board[4];
+/* The whole game lives here - see sim.h. Key and mouse callbacks only record into
+   inputs, the next step() applies them */
+Game game;
+Inputs inputs;
 
-Brick bricks[100];
+LaserView laser_view;
 
-Basket baskets[2];
+BasketView basket_views[2];
 
-Bullet bullets[100];
+float PAN, ZOOM;
 
-Mirror mirrors[5];
+InstanceBatch *brick_batch, *mirror_batch;
 
-std::vector<int> regenerateBrick;
-std::vector<int> regenerateBullet;
-//myvector.back();
-//myvector.pop_back();
-//myvector.push_back(myint);
-//myvector.size();
+/* Per-object path meshes - bricks indexed by Color, mirrors outlined in black */
+VAO *brick_meshes[COLOR_COUNT], *mirror_mesh;
 
-int total_bricks, total_score, game_over, total_bullets, total_mirrors, total_time;
+/* How moving entities reach the GPU - 'i' cycles through these to compare them */
+enum RenderPath {
+    RENDER_PER_OBJECT,  // own draw and MVP upload per entity
+    RENDER_INSTANCED,   // shared mesh per entity type plus per-instance offsets
+    RENDER_STREAMED,    // world-space vertices in the mapped stream ring, one draw per layer
+    RENDER_PATHS
+};
 
-float bricks_speed, mirror_rotate_speed, mirror_trans_speed_1, mirror_trans_speed_2, PAN, ZOOM;
+int render_path;
 
-double last_update_bullet_time, current_bullet_time, curr_mirror_time, last_update_mirror_time;
+/* The simulation advances in fixed steps of TICK seconds whatever the refresh rate;
+   draw() blends the last two steps so motion stays smooth in between */
+const double TICK = SIM_TICK;
+/* Longest frame the accumulator will take - past this the game slows down instead of
+   running hundreds of ticks to catch up after a stall */
+const double MAX_FRAME_TIME = 0.25;
 
-bool level1, level2, level3, mirror_up_1, mirror_up_2;
+/* 1 waits for vblank, 0 renders as fast as possible (--uncapped) */
+int swap_interval = 1;
 
-void chooseCol(int brick_num) {
-  int col=(rand()%2);
-  switch(col){
-    case 0:
-      bricks[brick_num].create(randomFloat(-2.3, -1.3));
-      break; //optional
-    case 1:
-      bricks[brick_num].create(randomFloat(0.8, 2.5));
-      break; //optional
-  }
-}
+/* --seed replays a game, otherwise each run gets its own */
+uint64_t game_seed;
 
-void createBrick() {
-  if(regenerateBrick.size()!=0){
-    chooseCol(regenerateBrick.back());
-    regenerateBrick.pop_back();
-  }
-  else {
-    chooseCol(total_bricks);
-    total_bricks++;
-  }
-}
+/* --record keeps every tick's inputs, written out when the game ends or quits */
+const char* record_path = NULL;
+InputRecorder recorder;
 
-void shootBullet() {
-  if(regenerateBullet.size()!=0){
-    bullets[regenerateBullet.back()].create(laser.rotate_angle);
-    regenerateBullet.pop_back();
-  }
-  else {
-    bullets[total_bullets].create(laser.rotate_angle);
-    total_bullets++;
-  }
-}
-
-void checkBrickYLimit() {
-  int i;
-  for(i=0;i<total_bricks&&bricks[i].status;i++) {
-    if(bricks[i].y<baskets[0].y) {
-      regenerateBrick.push_back(i);
-      bricks[i].vanish();
-    }
-  }
-}
+/* --net plays co-op against another instance, each driving one basket */
+Netplay netplay;
 
-void checkRedBasket() {
-  int i;
-  for(i=0;i<total_bricks&&bricks[i].status;i++) {
-    if(bricks[i].color=="red" || bricks[i].color=="black") {
-      if(bricks[i].y>=baskets[0].y && (bricks[i].y-bricks[i].length)<=baskets[0].y &&
-        (baskets[0].x-baskets[0].width)<=(bricks[i].x-bricks[i].width) && baskets[0].x>=bricks[i].x) {
-        
-        if(bricks[i].color=="black")
-          game_over=1;
-        else{
-          total_score+=3;
-          regenerateBrick.push_back(i);
-          bricks[i].vanish();
-        }
-      }
-    }
-  }
+void closeNetplay () {
+  if(netplay.running)
+    netplay.close();
 }
 
-void checkGreenBasket() {
-  int i;
-  for(i=0;i<total_bricks&&bricks[i].status;i++) {
-    if(bricks[i].color=="green" || bricks[i].color=="black") {
-      if(bricks[i].y>=baskets[1].y && (bricks[i].y-bricks[i].length)<=baskets[1].y &&
-        (baskets[1].x-baskets[1].width)<=(bricks[i].x-bricks[i].width) && baskets[1].x>=bricks[i].x) {
-        
-        if(bricks[i].color=="black")
-          game_over=1;
-        else{
-          total_score+=3;
-          regenerateBrick.push_back(i);
-          bricks[i].vanish();
-          //printf("Caught Green %d\n", i);
-        }
-      }
-    }
-  }
+void saveRecording () {
+  if(!record_path)
+    return;
+  recorder.finish(game.ticks);
+  if(recorder.save(record_path))
+    printf("recorded %u ticks to %s\n", game.ticks, record_path);
+  record_path = NULL;
 }
 
-void checkBrickBulletCollision () {
-  int i, j;
-  float y_brick_center, x_brick_center, x_axis_check, y_axis_check;
-  for(i=0;i<total_bricks&&bricks[i].status;i++) {
-    y_brick_center = bricks[i].y - (bricks[i].length/2);
-    x_brick_center = bricks[i].x - (bricks[i].width/2);
-    for(j=0;j<total_bullets;j++) {
-      x_axis_check = (bricks[i].width/2) + bullets[j].radius;
-      y_axis_check = (bricks[i].length/2) + bullets[j].radius;
-      if(abs(y_brick_center-bullets[j].y)<=y_axis_check&&abs(x_brick_center-bullets[j].x)<=x_axis_check) {
-        if(bricks[i].color=="black")
-          total_score+=2;
-        regenerateBrick.push_back(i);
-        bricks[i].vanish();
-        break;
-      }
-    }
-  }
+float interpolate (float previous, float current, float alpha) {
+  return previous + (current - previous) * alpha;
 }
 
-void checkMirrorBulletCollision () {
-  int i, j, k=0;
-  float y_brick_center, x_brick_center, x_axis_check, y_axis_check;
-  float c, m;
-  for(i=0;i<total_mirrors;i++) {
-    m = tan(mirrors[i].rotate_angle*M_PI/180.0f);
-    c = mirrors[i].y-m*mirrors[i].x;
-    for(j=0;j<total_bullets;j++) {
-      if(abs(bullets[j].y-m*bullets[j].x-c)<0.07&&abs(bullets[j].x-mirrors[i].x)<=mirrors[i].width/2){
-        bullets[j].rotate_angle=2*mirrors[i].rotate_angle-bullets[j].rotate_angle;
-        bullets[j].reflected=1;
-        bullets[j].x_laser_shift=bullets[j].x;
-        bullets[j].y_laser_shift=bullets[j].y;
-        bullets[j].vector_translate=0.04;
-      }
-    }
-  }
+void updateDisplays () {
+  score_display.update(game.total_score);
+  clock_display.update(game.total_time);
 }
 
-void checkBulletOutOfWindow () {
-  int i;
-  for(i=0;i<total_bullets;i++) {
-    if(abs(bullets[i].x)>25||abs(bullets[i].y)>25) {
-      regenerateBullet.push_back(i);
+/* Advance the game by one TICK - all movement happens in step(), never in draw() */
+void tick () {
+  inputs.cursor_x = getMouseCoordX();
+  inputs.cursor_y = getMouseCoordY();
+  if(netplay.running) {
+    // Presses wait for a tick that takes them
+    if(netplay.advance(inputs))
+      clearInputs(inputs);
+    // Over only once no late input from the other side can change that
+    if(game.game_over && netplay.confirmed()) {
+      netplay.finish(1);
+      printf("%u rollbacks, %u ticks played again, %u stalls, %u desyncs\n",
+        netplay.rollbacks, netplay.resimulated, netplay.stalls, netplay.desyncs);
+      exit(0);
     }
+    updateDisplays();
+    return;
   }
-}
-
-void setRandomizedMirror () {
-  curr_mirror_time = glfwGetTime();
-  if((curr_mirror_time-last_update_mirror_time) >=1.5 && level3) {
-    int col=rand()%2;
-    float x_coord;
-    if(col)
-      x_coord=randomFloat(-2.3, -1.3);
-    else
-      x_coord=randomFloat(0.8, 2.5);
-    mirrors[4].create(x_coord, randomFloat(-1.6, 2.2), randomFloat(-360, 360));
-    last_update_mirror_time=curr_mirror_time;
-  }
-}
-
-void checkLevel() {
-  if(total_score>=3 && total_score<=6)
-    level2=1;
-  else if(total_score>6){
-    level3=1;
-    total_mirrors=5;
-  }
-}
-
-void checkGameOver () {
-  if(game_over)
+  if(record_path)
+    recorder.record(game.ticks, inputs);
+  step(game, TICK, inputs);
+  clearInputs(inputs);
+  if(game.game_over) {
+    saveRecording();
     exit(0);
-}
-
-void updateScore () {
-  if((total_score/100)==0) {
-    score_board[0].create(3.5, 3.5, total_score%10);
-    score_board[1].create(3.2, 3.5, total_score/10);
-  }
-}
-
-void updateClock () {
-  if((total_time)==0) {
-    game_over=1;
-  }
-  else{
-    score_board[2].create(-3.2, 3.5, total_time%10);
-    score_board[3].create(-3.5, 3.5, total_time/10);
-    total_time--;
   }
-}
-
-void updateMouseLaserAngle (float X, float Y) {
-  float midX, midY, new_angle;
-  new_angle = atan((laser.y_stick_shift - Y)/(laser.x_stick_shift - X))*180.0f/M_PI;
-  laser.rotate_angle = new_angle;
-}
-
-void updateBasketCursor () {
-  baskets[0].followCursor();
-  baskets[1].followCursor();
-}
-
-void updateGameStatus () {
-  checkRedBasket();
-  checkGreenBasket();
-  checkGameOver();
-  updateBasketCursor();
-  checkBrickBulletCollision();
-  checkMirrorBulletCollision();
-  checkBulletOutOfWindow();
-  checkBrickYLimit();
-  checkLevel();
-  updateScore();
-  updateMouseLaserAngle(getMouseCoordX(), getMouseCoordY());
-  setRandomizedMirror();
+  updateDisplays();
 }
 
 /**************************
@@ -1158,37 +1340,33 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
     if (action == GLFW_RELEASE) {
         switch (key) {
             case GLFW_KEY_SPACE:
-                current_bullet_time = glfwGetTime(); // Time in seconds
-                if ((current_bullet_time - last_update_bullet_time) >= 1.0) {
-                  last_update_bullet_time = current_bullet_time;
-                  shootBullet();
-                }
+                inputs.shoot = 1;
                 break;
             case GLFW_KEY_A:
-                laser.stickMoveUp();
+                inputs.stick_move++;
                 break;
             case GLFW_KEY_D:
-                laser.stickMoveDown();
+                inputs.stick_move--;
                 break;
             case GLFW_KEY_S:
-                laser.moveUp();
+                inputs.laser_move++;
                 break;
             case GLFW_KEY_F:
-                laser.moveDown();
+                inputs.laser_move--;
                 break;
             case GLFW_KEY_LEFT:
                 if(mods == GLFW_MOD_CONTROL)
-                  baskets[0].moveLeft();
+                  inputs.basket_move[0]--;
                 else if(mods == GLFW_MOD_ALT)
-                  baskets[1].moveLeft();
+                  inputs.basket_move[1]--;
                 else
                   PAN -= 1;
                 break;
             case GLFW_KEY_RIGHT:
                 if(mods == GLFW_MOD_CONTROL)
-                  baskets[0].moveRight();
+                  inputs.basket_move[0]++;
                 else if(mods == GLFW_MOD_ALT)
-                  baskets[1].moveRight();
+                  inputs.basket_move[1]++;
                 else {
                   printf("asdasd\n");
                   PAN += 1;
@@ -1201,12 +1379,25 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
                 ZOOM -= 0.2;
                 break;
             case GLFW_KEY_N:
-                if(bricks_speed<=0.02)
-                  bricks_speed+=0.001;
+                inputs.speed_change++;
                 break;
             case GLFW_KEY_M:
-                if(bricks_speed>=0.003)
-                  bricks_speed+=-0.001;
+                inputs.speed_change--;
+                break;
+            case GLFW_KEY_I:
+                render_path = (render_path+1)%RENDER_PATHS;
+                break;
+            case GLFW_KEY_P:
+                printGPUResources();
+                printStaging();
+                printGLState();
+                printRenderQueue();
+                break;
+            case GLFW_KEY_C:
+                if(bullet_shader == SHADER_SDF_CIRCLE)
+                  bullet_shader = SHADER_DEFAULT;
+                else
+                  bullet_shader = SHADER_SDF_CIRCLE;
                 break;
             default:
                 break;
@@ -1241,33 +1432,12 @@ void mouseButton (GLFWwindow* window, int button, int action, int mods)
 {
     switch (button) {
         case GLFW_MOUSE_BUTTON_LEFT:
-            if (action == GLFW_RELEASE) {
-              current_bullet_time = glfwGetTime(); // Time in seconds
-              if ((current_bullet_time - last_update_bullet_time) >= 1.0) {
-                last_update_bullet_time = current_bullet_time;
-                shootBullet();
-              }
-            }
+            if (action == GLFW_RELEASE)
+                inputs.shoot = 1;
             break;
         case GLFW_MOUSE_BUTTON_RIGHT:
-            if (action == GLFW_RELEASE) {
-                if(baskets[0].selected || baskets[1].selected) {
-                  if(baskets[0].selected)
-                    baskets[0].selected = 0;
-                  else if(baskets[1].selected)
-                    baskets[1].selected = 0;
-                }
-                else {
-                  if(getMouseCoordX()<baskets[0].x&&getMouseCoordX()>(baskets[0].x-baskets[0].width)&&
-                    getMouseCoordY()<baskets[0].y&&getMouseCoordY()>(baskets[0].y-baskets[0].length)) {
-                    baskets[0].selected = 1;
-                  }
-                  else if(getMouseCoordX()<baskets[1].x&&getMouseCoordX()>(baskets[1].x-baskets[1].width)&&
-                    getMouseCoordY()<baskets[1].y&&getMouseCoordY()>(baskets[1].y-baskets[1].length)) {
-                    baskets[1].selected = 1;
-                  }
-                }
-            }
+            if (action == GLFW_RELEASE)
+                inputs.select_basket = 1;
             break;
         default:
             break;
@@ -1385,21 +1555,77 @@ void createRectangle (float x_shift, float y_shift, int rect_num)
   rectangle = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
 
+/* Unit meshes shared by every brick and mirror in the instanced path - bullets use getBulletMesh */
+void createInstancedMeshes ()
+{
+  float x_coord=0.08, y_coord=0.15;
+
+  GLfloat vertex_buffer_data_brick [] = {
+    -x_coord,-y_coord,0, // vertex 1
+    -x_coord,y_coord,0, // vertex 2
+    x_coord,y_coord,0, // vertex 3
+
+    x_coord,y_coord,0, // vertex 3
+    x_coord,-y_coord,0, // vertex 4
+    -x_coord,-y_coord,0  // vertex 1
+  };
+
+  // White so that the per-instance color shows through unchanged
+  brick_batch = createInstanceBatch(create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_brick, 1, 1, 1, GL_FILL));
+  brick_meshes[COLOR_RED] = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_brick, 1, 0, 0, GL_FILL);
+  brick_meshes[COLOR_GREEN] = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_brick, 0, 1, 0, GL_FILL);
+  brick_meshes[COLOR_BLACK] = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_brick, 0, 0, 0, GL_FILL);
+
+  x_coord=0.6, y_coord=0.01;
+
+  GLfloat vertex_buffer_data_mirror [] = {
+    -x_coord,-y_coord,0, // vertex 1
+    -x_coord,y_coord,0, // vertex 2
+    x_coord,y_coord,0, // vertex 3
+
+    x_coord,y_coord,0, // vertex 3
+    x_coord,-y_coord,0, // vertex 4
+    -x_coord,-y_coord,0  // vertex 1
+  };
+
+  mirror_batch = createInstanceBatch(create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_mirror, 1, 1, 1, GL_LINE));
+  mirror_mesh = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_mirror, 0, 0, 0, GL_LINE);
+
+  // Scaled by the Radius uniform of the SDF program
+  GLfloat vertex_buffer_data_quad [] = {
+    -1,-1,0, // vertex 1
+    -1,1,0, // vertex 2
+    1,1,0, // vertex 3
+
+    1,1,0, // vertex 3
+    1,-1,0, // vertex 4
+    -1,-1,0  // vertex 1
+  };
+
+  sdf_bullet_mesh.mesh = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data_quad, 1, 1, 1, GL_FILL);
+  sdf_bullet_mesh.batch = createInstanceBatch(sdf_bullet_mesh.mesh);
+}
+
 float camera_rotation_angle = 90;
 float rectangle_rotation = 0;
 float triangle_rotation = 0;
 float fall_down_speed = 0;
 
 /* Render the scene with openGL */
-/* Edit this function according to your assignment */
-void draw ()
+/* Only reads game state - alpha in [0,1) blends the previous tick into the current one */
+void draw (float alpha)
 {
+  // Uploads copy their data into GL, so last frame's staging memory is free again
+  stagingReset();
+  resetGLStateCounters();
+
   // clear the color and depth in the frame buffer
-  glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  if(render_queue.depth_test)
+    glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  else
+    glClear (GL_COLOR_BUFFER_BIT);
 
-  // use the loaded shader program
-  // Don't change unless you know what you are doing
-  glUseProgram (programID);
+  // Shader programs are picked per item by flushRenderQueue
 
   Matrices.projection = glm::ortho((-4.0f+PAN)/ZOOM, (4.0f+PAN)/ZOOM, -4.0f/ZOOM, 4.0f/ZOOM, 0.1f, 500.0f);
 
@@ -1444,187 +1670,116 @@ void draw ()
 
   // Pop matrix to undo transformations till last push matrix instead of recomputing model matrix
   // glPopMatrix ();
-  int i;
+  int i, k;
+
+  const Laser& laser = game.laser;
+  const Basket* baskets = game.baskets;
+  const BrickPool& bricks = game.bricks;
+  const BulletPool& bullets = game.bullets;
+  const Mirror* mirrors = game.mirrors;
+
+  if(render_path == RENDER_STREAMED)
+    beginStream();
 
   // Draw Bricks
-  for(i=0;i<total_bricks;i++) {
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateObject = glm::translate (glm::vec3(0, bricks[i].y_shift, 0));        // glTranslatef
-    //glm::mat4 rotateObject = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-    Matrices.model *= (translateObject);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    bricks[i].y_shift-=bricks_speed;
-    bricks[i].y -= bricks_speed;
-    draw3DObject(bricks[i].brickObj);
+  for(k=0;k<bricks.live.size();k++) {
+    i = bricks.live.dense[k];
+    float x_brick = bricks.x[i]-bricks.width[i]/2;
+    float y_brick = interpolate(bricks.prev_y[i], bricks.y[i], alpha)-bricks.length[i]/2;
+    int red = (bricks.color[i]==COLOR_RED), green = (bricks.color[i]==COLOR_GREEN);
+    if(render_path == RENDER_PER_OBJECT)
+      submit(brick_meshes[bricks.color[i]], glm::translate (glm::vec3(x_brick, y_brick, 0)), LAYER_BRICKS);
+    else if(render_path == RENDER_INSTANCED)
+      addInstance(brick_batch, x_brick, y_brick, 0, red, green, 0);
+    else
+      streamQuad(x_brick, y_brick, bricks.width[i]/2, bricks.length[i]/2, 0, red*255, green*255, 0);
   }
+  submitInstances(brick_batch, LAYER_BRICKS);
+  if(render_path == RENDER_STREAMED)
+    streamLayer(LAYER_BRICKS);
 
   // Draw Baskets
   for(i=0;i<2;i++) {
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateObject = glm::translate (glm::vec3(baskets[i].x_shift, baskets[i].y_shift, 0));
-    Matrices.model *= (translateObject);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    draw3DObject(baskets[i].basketObj);
-
-    Matrices.model = glm::mat4(1.0f);
-    translateObject = glm::translate (glm::vec3(baskets[i].x_shift-(baskets[i].width/4), baskets[i].y_shift, 0));
-    Matrices.model *= (translateObject);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    draw3DObject(baskets[i].mouthObj1);
-
-    Matrices.model = glm::mat4(1.0f);
-    translateObject = glm::translate (glm::vec3(baskets[i].x_shift+(baskets[i].width/4), baskets[i].y_shift, 0));
-    Matrices.model *= (translateObject);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    draw3DObject(baskets[i].mouthObj2);
+    if(render_path == RENDER_STREAMED) {
+      streamVertices(basket_views[i].shape, 6, baskets[i].x_shift, baskets[i].y_shift);
+      streamVertices(basket_views[i].shape+6, 6, baskets[i].x_shift-(baskets[i].width/4), baskets[i].y_shift);
+      streamVertices(basket_views[i].shape+12, 6, baskets[i].x_shift+(baskets[i].width/4), baskets[i].y_shift);
+      continue;
+    }
+    submit(basket_views[i].basketObj, glm::translate (glm::vec3(baskets[i].x_shift, baskets[i].y_shift, 0)), LAYER_BASKETS);
+    submit(basket_views[i].mouthObj1, glm::translate (glm::vec3(baskets[i].x_shift-(baskets[i].width/4), baskets[i].y_shift, 0)), LAYER_BASKETS);
+    submit(basket_views[i].mouthObj2, glm::translate (glm::vec3(baskets[i].x_shift+(baskets[i].width/4), baskets[i].y_shift, 0)), LAYER_BASKETS);
   }
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
+  if(render_path == RENDER_STREAMED)
+    streamLayer(LAYER_BASKETS);
 
   // Draw Laser
-  Matrices.model = glm::mat4(1.0f);
-  glm::mat4 translateLaser = glm::translate (glm::vec3(0, laser.y_shift, 0));
-  Matrices.model *= (translateLaser);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(laser.laserObj);
+  submit(laser_view.laserObj, glm::translate (glm::vec3(0, laser.y_shift, 0)), LAYER_LASER);
 
-  Matrices.model = glm::mat4(1.0f);
   glm::mat4 translateObject = glm::translate (glm::vec3(laser.x_stick_shift, laser.y_stick_shift, 0));        // glTranslatef
   glm::mat4 rotateObject = glm::rotate((float)(laser.rotate_angle*M_PI/180.0f), glm::vec3(0,0,1));
-  Matrices.model *= (translateObject * rotateObject);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(laser.stickObj);
+  submit(laser_view.stickObj, translateObject * rotateObject, LAYER_LASER);
 
   // Draw bullets
-  for(i=0;i<total_bullets;i++) {
-    Matrices.model = glm::mat4(1.0f);
-    if(!bullets[i].reflected) {
-      bullets[i].x_laser_shift = laser.x_stick+laser.x_bullet;
-      bullets[i].y_laser_shift = laser.y_stick-(laser.stick_length/2)+laser.y_bullet;
-    }
-    bullets[i].x = bullets[i].x_laser_shift+bullets[i].vector_translate*cos(bullets[i].rotate_angle*M_PI/180.0f);
-    bullets[i].y = bullets[i].y_laser_shift+bullets[i].vector_translate*sin(bullets[i].rotate_angle*M_PI/180.0f);
-    glm::mat4 translateBullet = glm::translate (glm::vec3(bullets[i].x, bullets[i].y, 0));    
-    Matrices.model *= (translateBullet);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    bullets[i].vector_translate+=0.04;
-    draw3DObject(bullets[i].bulletObj);
+  CircleMesh& bullet_mesh = (bullet_shader == SHADER_SDF_CIRCLE) ? sdf_bullet_mesh : getBulletMesh(ZOOM);
+  int bullet_parts = circleSegments(bullet_radius, ZOOM);
+  for(k=0;k<bullets.live.size();k++) {
+    i = bullets.live.dense[k];
+    float bullet_x = interpolate(bullets.prev_x[i], bullets.x[i], alpha);
+    float bullet_y = interpolate(bullets.prev_y[i], bullets.y[i], alpha);
+    if(render_path == RENDER_INSTANCED)
+      addInstance(bullet_mesh.batch, bullet_x, bullet_y, 0, 1, 1, 1);
+    else if(render_path == RENDER_STREAMED)
+      streamCircle(bullet_x, bullet_y, bullet_radius, bullet_parts, 255, 255, 255);
+    else
+      submit(bullet_mesh.mesh, glm::translate (glm::vec3(bullet_x, bullet_y, 0)), LAYER_BULLETS, bullet_shader);
   }
+  submitInstances(bullet_mesh.batch, LAYER_BULLETS, bullet_shader);
+  if(render_path == RENDER_STREAMED)
+    streamLayer(LAYER_BULLETS);
 
   // Draw mirrors
   glm::mat4 rotateMirror;
-  for(i=0;i<total_mirrors;i++) {
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateMirror = glm::translate (glm::vec3(mirrors[i].x_shift, mirrors[i].y_shift, 0));
-    if(i<2) {
-      if(i==0){
-        if(level1)  
-          mirrors[i].rotate_angle+=mirror_rotate_speed;
-        if(level2) {
-          mirrors[i].rotate_angle+=mirror_rotate_speed+3;
-          mirrors[i].y-=mirror_trans_speed_1;
-          if((mirrors[i].y_shift+mirror_trans_speed_1)<0.0)
-            mirror_up_1=1;
-          if((mirrors[i].y_shift+mirror_trans_speed_1)>2.9)
-            mirror_up_1=0;
-          if(!mirror_up_1)
-            mirror_trans_speed_1-=0.007;
-          else
-            mirror_trans_speed_1+=0.007;
-          translateMirror = glm::translate (glm::vec3(mirrors[i].x_shift, mirrors[i].y_shift+mirror_trans_speed_1, 0));
-          mirrors[i].y+=mirror_trans_speed_1;
-        }
-      }
-      else {
-        if(level2) {
-          if(mirrors[i].rotate_angle<-150) {
-            mirrors[i].rotate_angle=0;
-            mirror_up_2=1;
-          }
-          if(mirrors[i].rotate_angle>150) {
-            mirrors[i].rotate_angle=0;
-            mirror_up_2=0;
-          }
-          if(!mirror_up_2)
-            mirrors[i].rotate_angle-=mirror_rotate_speed+0.7;
-          else
-            mirrors[i].rotate_angle+=mirror_rotate_speed+0.7;
-        }
-      }
+  for(i=0;i<game.total_mirrors;i++) {
+    float y_mirror = interpolate(mirrors[i].prev_y_center, mirrors[i].y_center, alpha);
+    float mirror_angle = interpolate(mirrors[i].prev_rotate_angle, mirrors[i].rotate_angle, alpha);
+    if(render_path == RENDER_INSTANCED) {
+      addInstance(mirror_batch, mirrors[i].x_shift, y_mirror, mirror_angle, 0, 0, 0);
+      continue;
+    }
+    if(render_path == RENDER_STREAMED) {
+      // Filled rather than outlined - at 0.02 thick the two look the same
+      streamQuad(mirrors[i].x_shift, y_mirror, mirrors[i].width/2, mirrors[i].length/2, mirror_angle, 0, 0, 0);
+      continue;
     }
-    rotateMirror = glm::rotate((float)(mirrors[i].rotate_angle*M_PI/180.0f), glm::vec3(0,0,1));
-    Matrices.model *= (translateMirror * rotateMirror);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    draw3DObject(mirrors[i].mirrorObj);
+    glm::mat4 translateMirror = glm::translate (glm::vec3(mirrors[i].x_shift, y_mirror, 0));
+    rotateMirror = glm::rotate((float)(mirror_angle*M_PI/180.0f), glm::vec3(0,0,1));
+    submit(mirror_mesh, translateMirror * rotateMirror, LAYER_MIRRORS);
   }
+  submitInstances(mirror_batch, LAYER_MIRRORS);
 
-  for(i=0;i<4;i++) {
-    if(score_board[i].A) {
-      Matrices.model = glm::mat4(1.0f);
-      glm::mat4 translateA = glm::translate (glm::vec3(score_board[i].x_shift, score_board[i].y_shift, 0));
-      Matrices.model *= (translateA);
-      MVP = VP * Matrices.model;
-      glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-      draw3DObject(score_board[i].a);
-    }
-    if(score_board[i].B) {
-      Matrices.model = glm::mat4(1.0f);
-      glm::mat4 translateB = glm::translate (glm::vec3(score_board[i].x_shift, score_board[i].y_shift, 0));
-      Matrices.model *= (translateB);
-      MVP = VP * Matrices.model;
-      glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-      draw3DObject(score_board[i].b);
-    }
-    if(score_board[i].C) {
-      Matrices.model = glm::mat4(1.0f);
-      glm::mat4 translateC = glm::translate (glm::vec3(score_board[i].x_shift, score_board[i].y_shift, 0));
-      Matrices.model *= (translateC);
-      MVP = VP * Matrices.model;
-      glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-      draw3DObject(score_board[i].c);
-    }
-    if(score_board[i].D) {
-      Matrices.model = glm::mat4(1.0f);
-      glm::mat4 translateD = glm::translate (glm::vec3(score_board[i].x_shift, score_board[i].y_shift, 0));
-      Matrices.model *= (translateD);
-      MVP = VP * Matrices.model;
-      glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-      draw3DObject(score_board[i].d);
-    }
-    if(score_board[i].E) {
-      Matrices.model = glm::mat4(1.0f);
-      glm::mat4 translateE = glm::translate (glm::vec3(score_board[i].x_shift, score_board[i].y_shift, 0));
-      Matrices.model *= (translateE);
-      MVP = VP * Matrices.model;
-      glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-      draw3DObject(score_board[i].e);
-    }
-    if(score_board[i].F) {
-      Matrices.model = glm::mat4(1.0f);
-      glm::mat4 translateF = glm::translate (glm::vec3(score_board[i].x_shift, score_board[i].y_shift, 0));
-      Matrices.model *= (translateF);
-      MVP = VP * Matrices.model;
-      glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-      draw3DObject(score_board[i].f);
-    }
-    if(score_board[i].G) {
-      Matrices.model = glm::mat4(1.0f);
-      glm::mat4 translateG = glm::translate (glm::vec3(score_board[i].x_shift, score_board[i].y_shift, 0));
-      Matrices.model *= (translateG);
-      MVP = VP * Matrices.model;
-      glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-      draw3DObject(score_board[i].g);
+  if(render_path == RENDER_STREAMED) {
+    streamLayer(LAYER_MIRRORS);
+    endStream();
+  }
+
+  // Draw score and clock
+  SevenSegmentDisplay* displays[] = { &score_display, &clock_display };
+  for(i=0;i<2;i++) {
+    for(int j=0;j<(int)displays[i]->digits.size();j++) {
+      SevenSegment& digit = displays[i]->digits[j];
+      glm::mat4 translateDigit = glm::translate (glm::vec3(digit.x_shift, digit.y_shift, 0));
+      for(int k=0;k<7;k++)
+        if(digit.segments & (1<<k))
+          submit(segmentObj[k], translateDigit, LAYER_HUD);
     }
   }
 
+  flushRenderQueue(VP);
+
+  if(render_path == RENDER_STREAMED)
+    fenceStream();
+
 /*
   //TEST POINT
   Matrices.model = glm::mat4(1.0f);
@@ -1668,7 +1823,9 @@ GLFWwindow* initGLFW (int width, int height)
 
     glfwMakeContextCurrent(window);
     gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
-    glfwSwapInterval( 1 );
+    gpu_resources.context_alive = 1;
+    invalidateGLState();
+    glfwSwapInterval( swap_interval );
 
     /* --- register callbacks with GLFW --- */
 
@@ -1697,40 +1854,38 @@ void initGL (GLFWwindow* window, int width, int height)
 {
     /* Objects should be created before any other gl function and shaders */
 	// Create the models
-  total_bricks=0;
-  total_score=0;
-  total_time=60;
-  game_over=0;
-  total_mirrors=4;
-  total_bullets=0;
-  bricks_speed=0.005;
-  mirror_rotate_speed=1;
-  mirror_trans_speed_1=0;
-  mirror_trans_speed_2=0;
-  mirror_up_1=0;
-  mirror_up_2=0;
-  laser.create();
-  baskets[0].color="red";
-  baskets[1].color="green";
-  baskets[0].create();
-  baskets[1].create();
-  mirrors[0].create(0.2, 2.9, -30);
-  mirrors[1].create(0.2, -1.7, 25);
-  mirrors[2].create(3.2, 2.3, -45);
-  mirrors[3].create(3.6, -1.6, 60);
-  level1=1;
-  level2=0;
-  level3=0;
+  initGame(game, game_seed);
+  clearInputs(inputs);
+  if(record_path)
+    recorder.begin(game_seed);
+  if(netplay.connected)
+    netplay.start(game);
+  laser_view.create();
+  basket_views[0].create(game.baskets[0]);
+  basket_views[1].create(game.baskets[1]);
   PAN=0;
   ZOOM=1;
-  updateClock();
-  updateScore();
+  score_display.create(3.5, 3.5, 2);
+  clock_display.create(-3.2, 3.5, 2);
+  updateDisplays();
   //testPoint();
 	
 	// Create and compile our GLSL program from the shaders
-	programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
-	// Get a handle for our "MVP" uniform
-	Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+	loadProgram(SHADER_DEFAULT, "Sample_GL.vert", "Sample_GL.frag");
+	loadProgram(SHADER_SDF_CIRCLE, "Sample_SDF.vert", "Sample_SDF.frag");
+	// Bullets are the only discs, so the SDF radius is set once
+	useProgram(SHADER_SDF_CIRCLE);
+	glUniform1f(glGetUniformLocation(programs[SHADER_SDF_CIRCLE].ProgramID, "Radius"), bullet_radius);
+	bullet_shader=SHADER_SDF_CIRCLE;
+
+	// Non-instanced draws read the default per-instance attributes - no offset, no rotation, white
+	glVertexAttrib3f(2, 0, 0, 0);
+	glVertexAttrib3f(3, 1, 1, 1);
+	createInstancedMeshes();
+	createSegments();
+	getBulletMesh(ZOOM);
+	createStreamBuffer(16384);
+	render_path=RENDER_INSTANCED;
 
 	
 	reshapeWindow (window, width, height);
@@ -1739,8 +1894,11 @@ void initGL (GLFWwindow* window, int width, int height)
 	glClearColor (0.6f, 0.6f, 0.6f, 0.0f); // R, G, B, A
 	glClearDepth (1.0f);
 
-	glEnable (GL_DEPTH_TEST);
+	// Everything sits at z=0 and layers give the draw order, so depth testing only costs fill rate
+	render_queue.depth_test = 0;
+	render_queue.depth_test_on = 0;
 	glDepthFunc (GL_LEQUAL);
+	glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     cout << "VENDOR: " << glGetString(GL_VENDOR) << endl;
     cout << "RENDERER: " << glGetString(GL_RENDERER) << endl;
@@ -1748,29 +1906,80 @@ void initGL (GLFWwindow* window, int width, int height)
     cout << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
 }
 
+/* bench/render_bench includes this file for the renderer and brings its own main */
+#ifndef CRAZYBRICKS_NO_MAIN
 int main (int argc, char** argv)
 {
 	width = 1000;
 	height = 600;
 
+  int net_player = 0, net_port = 0, input_delay = NET_DEFAULT_INPUT_DELAY;
+  const char* net_peer = NULL;
+  double net_latency = 0, net_jitter = 0;
+  float net_loss = 0;
+
+  game_seed = (uint64_t)time(NULL);
+  for(int i=1;i<argc;i++) {
+    if(!strcmp(argv[i], "--uncapped"))
+      swap_interval = 0;
+    else if(!strcmp(argv[i], "--seed") && i+1<argc)
+      game_seed = strtoull(argv[++i], NULL, 10);
+    else if(!strcmp(argv[i], "--record") && i+1<argc)
+      record_path = argv[++i];
+    else if(!strcmp(argv[i], "--net") && i+3<argc) {
+      net_player = atoi(argv[++i]);
+      net_port = atoi(argv[++i]);
+      net_peer = argv[++i];
+    }
+    else if(!strcmp(argv[i], "--input-delay") && i+1<argc)
+      input_delay = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--net-latency") && i+1<argc)
+      net_latency = atof(argv[++i]);
+    else if(!strcmp(argv[i], "--net-jitter") && i+1<argc)
+      net_jitter = atof(argv[++i]);
+    else if(!strcmp(argv[i], "--net-loss") && i+1<argc)
+      net_loss = atof(argv[++i]);
+    else if(!strcmp(argv[i], "--threads") && i+1<argc)
+      setJobThreads(atoi(argv[++i]));
+  }
+
+  if(net_peer) {
+    if(!netplay.open(net_player, net_port, net_peer, input_delay))
+      return 1;
+    netplay.setShim(net_latency, net_jitter, net_loss, game_seed+net_player);
+    printf("player %d on port %d, waiting for %s\n", net_player, net_port, net_peer);
+    if(!netplay.connect(game_seed, 60)) {
+      fprintf(stderr, "no answer from %s\n", net_peer);
+      return 1;
+    }
+    // The recording would only have this side's inputs
+    record_path = NULL;
+  }
+  printf("seed %llu\n", (unsigned long long)game_seed);
+
   GLFWwindow* window = initGLFW(width, height);
 
 	initGL (window, width, height);
 
-    double last_update_time = glfwGetTime(), current_time, last_game_time, current_game_time;
-
-    last_update_bullet_time = glfwGetTime();
-    last_game_time = glfwGetTime();
-    last_update_mirror_time = last_update_bullet_time;
+    double current_time, previous_frame_time = glfwGetTime(), frame_time, accumulator = 0;
 
     /* Draw in loop */
     while (!glfwWindowShouldClose(window)) {
 
-        // OpenGL Draw commands
-        draw();
+        // Run as many fixed ticks as the time since the last frame covers
+        current_time = glfwGetTime();
+        frame_time = current_time - previous_frame_time;
+        previous_frame_time = current_time;
+        if (frame_time > MAX_FRAME_TIME)
+            frame_time = MAX_FRAME_TIME;
+        accumulator += frame_time;
+        while (accumulator >= TICK) {
+            tick();
+            accumulator -= TICK;
+        }
 
-        // Update the game status each iter
-        updateGameStatus();
+        // OpenGL Draw commands, part way between the last two ticks
+        draw(accumulator / TICK);
 
         // Get cursor
         glfwGetCursorPos(window, &xpos, &ypos);
@@ -1780,21 +1989,11 @@ int main (int argc, char** argv)
 
         // Poll for Keyboard and mouse events
         glfwPollEvents();
-
-        // Control based on time (Time based transformation like 5 degrees rotation every 0.5s)
-        current_time = glfwGetTime(); // Time in seconds
-        if ((current_time - last_update_time) >= 1.5) { // atleast 1.5s elapsed since last frame
-            createBrick();
-            last_update_time = current_time;
-        }
-
-        current_game_time = glfwGetTime(); // Time in seconds
-        if ((current_game_time - last_game_time) >= 1.0) { // atleast 1.5s elapsed since last frame
-            updateClock();
-            last_game_time = current_game_time;
-        }
     }
 
+    saveRecording();
+    gpu_resources.context_alive = 0;
     glfwTerminate();
 //    exit(EXIT_SUCCESS);
-} 
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,20 @@
+#version 330 core
+
+// Interpolated values from the vertex shaders
+in vec3 fragColor;
+in vec2 localCoord;
+
+// output data
+out vec4 color;
+
+void main()
+{
+    // Signed distance to the disc edge is length - 1, fade it over one pixel
+    float d = length(localCoord);
+    float w = fwidth(d);
+    float alpha = 1.0 - smoothstep(1.0 - w, 1.0, d);
+    if (alpha <= 0.0)
+        discard;
+
+    color = vec4(fragColor, alpha);
+}
@@ -0,0 +1,31 @@
+#version 330 core
+
+// input data : sent from main program
+// vertexPosition is a corner of the unit quad [-1,1]x[-1,1]
+layout (location = 0) in vec2 vertexPosition;
+layout (location = 1) in vec4 vertexColor; // RGBA8, normalized
+
+// per-instance data : offset (x,y) and rotation in radians, and color
+layout (location = 2) in vec3 instanceTransform;
+layout (location = 3) in vec3 instanceColor;
+
+uniform mat4 MVP;
+uniform float Radius;
+
+// output data : used by fragment shader
+out vec3 fragColor;
+out vec2 localCoord;
+
+void main ()
+{
+    float s = sin(instanceTransform.z);
+    float c = cos(instanceTransform.z);
+    vec2 p = mat2(c, s, -s, c) * (vertexPosition * Radius) + instanceTransform.xy;
+
+    fragColor = vertexColor.rgb * instanceColor;
+
+    // Distance from the centre in radii, interpolated across the quad
+    localCoord = vertexPosition;
+
+    gl_Position = MVP * vec4(p, 0, 1);
+}
@@ -0,0 +1,71 @@
+/* Brick/bullet overlap - brute force scan against the uniform grid, over scenes
+   from a handful of bricks up to 100k, to find where the grid starts paying off.
+   BROADPHASE_MIN_PAIRS in sim.h comes from this.
+   Build with `make bench`, run as ./bench/broadphase_bench */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "scene.h"
+
+using namespace std;
+
+/* Bricks and one tick of bullet travel scattered over the playfield */
+void fill (Rng& rng, int n_bricks, int n_bullets, BrickPool& bricks, BulletPaths& paths) {
+  bricks.init(n_bricks);
+  paths.clear();
+  for(int i=0;i<n_bricks;i++) {
+    int slot = bricks.create(rng.uniform(-4, 4), (Color)rng.below(3));
+    bricks.y[slot] = rng.uniform(-4, 4);
+  }
+  for(int i=0;i<n_bullets;i++) {
+    float x = rng.uniform(-4, 4), y = rng.uniform(-4, 4), angle = rng.uniform(0, 2*M_PI);
+    paths.add(x, y, x+0.04f*cos(angle), y+0.04f*sin(angle), bullet_radius);
+  }
+}
+
+int main () {
+  static const int scenes[][2] = {
+    { 4, 1 }, { 10, 2 }, { 30, 5 }, { 100, 10 }, { 300, 30 }, { 1000, 100 },
+    { 3000, 300 }, { 10000, 1000 }, { 100000, 1000 }
+  };
+  BrickPool bricks;
+  BulletPaths paths;
+  BrickGrid grid;
+  vector<int> brute_hits, grid_hits;
+  Rng rng;
+  int failed = 0;
+
+  grid.init(-4, -4, 4, 4, 0.5);
+  rng.seed(1);
+  printf("  bricks  bullets      pairs   brute us    grid us  faster\n");
+  for(int s=0;s<(int)(sizeof(scenes)/sizeof(scenes[0]));s++) {
+    int n_bricks = scenes[s][0], n_bullets = scenes[s][1];
+    fill(rng, n_bricks, n_bullets, bricks, paths);
+
+    // Enough runs for roughly the same total work per scene
+    long pairs = (long)n_bricks*n_bullets;
+    int runs = (int)max(10L, min(100000L, 20000000L/pairs));
+    double t, brute, grid_time;
+
+    t = benchNow();
+    for(int r=0;r<runs;r++)
+      findBrickHits(bricks, paths, brute_hits);
+    brute = (benchNow()-t)/runs*1e6;
+    t = benchNow();
+    for(int r=0;r<runs;r++)
+      findBrickHitsGrid(grid, bricks, paths, grid_hits);
+    grid_time = (benchNow()-t)/runs*1e6;
+
+    printf("%8d %8d %10ld %10.2f %10.2f  %s\n", n_bricks, n_bullets, pairs, brute, grid_time,
+      brute<grid_time ? "brute" : "grid");
+    if(brute_hits != grid_hits) {
+      printf("  grid found %d hits, brute force %d\n", (int)grid_hits.size(), (int)brute_hits.size());
+      failed = 1;
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,135 @@
+/* Collision kernels at each level this CPU runs - checks the SSE and AVX2
+   versions give exactly what the scalar ones do, that the mirror reject never
+   drops a leg sweepCircleCapsule would hit, and that the grid (which runs on
+   the kernels) agrees with the scalar brute force scan. Then times them.
+   Build with `make bench`, run as ./bench/kernel_bench [bricks] [bullets] */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "collide.h"
+#include "scene.h"
+
+using namespace std;
+
+int main (int argc, char** argv) {
+  int n_bricks = argc>1 ? atoi(argv[1]) : 100000;
+  int n_bullets = argc>2 ? atoi(argv[2]) : 1000;
+  int i, j, level, failed = 0;
+  Rng rng;
+
+  rng.seed(1);
+  // Brick boxes as centre and half extents, and one tick of travel per bullet
+  vector<float> cx(n_bricks), cy(n_bricks), hw(n_bricks), hh(n_bricks);
+  for(i=0;i<n_bricks;i++) {
+    cx[i] = rng.uniform(-4, 4);
+    cy[i] = rng.uniform(-4, 4);
+    hw[i] = rng.uniform(0.02, 0.1);
+    hh[i] = rng.uniform(0.05, 0.2);
+  }
+  vector<float> x0(n_bullets), y0(n_bullets), x1(n_bullets), y1(n_bullets), radius(n_bullets, bullet_radius);
+  BulletPaths paths;
+  for(j=0;j<n_bullets;j++) {
+    float angle = rng.uniform(0, 2*M_PI), speed = rng.uniform(0.01, 1.0);
+    x0[j] = rng.uniform(-4, 4);
+    y0[j] = rng.uniform(-4, 4);
+    x1[j] = x0[j]+speed*cos(angle);
+    y1[j] = y0[j]+speed*sin(angle);
+    paths.add(x0[j], y0[j], x1[j], y1[j], radius[j]);
+  }
+
+  // The playfield mirrors, as moveBullets sees them
+  Game game;
+  initGame(game);
+  game.total_mirrors = 5;
+  game.mirrors[4].create(1.5, 0.5, 90);
+  float mx[MAX_MIRRORS], my[MAX_MIRRORS], ux[MAX_MIRRORS], uy[MAX_MIRRORS], mw[MAX_MIRRORS], mt[MAX_MIRRORS];
+  for(i=0;i<game.total_mirrors;i++) {
+    Mirror& mirror = game.mirrors[i];
+    ux[i] = mirror.ux;
+    uy[i] = mirror.uy;
+    mx[i] = mirror.cx;
+    my[i] = mirror.cy;
+    mw[i] = mirror.width/2;
+    mt[i] = mirror.length/2;
+  }
+  // Legs the exact sweep says touch a mirror
+  vector<unsigned char> touches(n_bullets, 0);
+  for(j=0;j<n_bullets;j++) {
+    float dx = x1[j]-x0[j], dy = y1[j]-y0[j], len = sqrtf(dx*dx + dy*dy), nx, ny;
+    for(i=0;i<game.total_mirrors;i++)
+      touches[j] |= sweepCircleCapsule(x0[j], y0[j], dx/len, dy/len, len, mx[i], my[i], ux[i], uy[i],
+                                       mw[i], radius[j]+mt[i], nx, ny) >= 0;
+  }
+
+  // Scalar results everything else must match
+  vector<unsigned char> box_ref(n_bricks, 0), near_ref(n_bullets);
+  setKernelLevel(KERNEL_SCALAR);
+  for(j=0;j<n_bullets;j++)
+    legHitsBoxes(paths.x[j], paths.y[j], paths.half_dx[j], paths.half_dy[j], radius[j],
+                 &cx[0], &cy[0], &hw[0], &hh[0], n_bricks, &box_ref[0]);
+  legsNearMirrors(&x0[0], &y0[0], &x1[0], &y1[0], &radius[0], n_bullets,
+                  mx, my, ux, uy, mw, mt, game.total_mirrors, &near_ref[0]);
+  for(j=0;j<n_bullets;j++)
+    if(touches[j] && !near_ref[j]) {
+      printf("mirror reject dropped leg %d, which touches a mirror\n", j);
+      failed = 1;
+    }
+
+  // Grid against brute force, over pools built from the same boxes
+  BrickPool bricks;
+  BrickGrid grid;
+  vector<int> brute_hits, grid_hits;
+  bricks.init(n_bricks);
+  for(i=0;i<n_bricks;i++) {
+    int slot = bricks.create(0, COLOR_RED);
+    bricks.x[slot] = cx[i]+hw[i];
+    bricks.y[slot] = cy[i]+hh[i];
+    bricks.width[slot] = 2*hw[i];
+    bricks.length[slot] = 2*hh[i];
+  }
+  grid.init(-4, -4, 4, 4, 0.5);
+  findBrickHits(bricks, paths, brute_hits);
+
+  printf("%d bricks, %d bullet legs, cpu runs up to %s\n", n_bricks, n_bullets, kernelLevelName(bestKernelLevel()));
+  printf("level     boxes ns/brick   mirrors ns/leg   grid us\n");
+  for(level=KERNEL_SCALAR;level<=bestKernelLevel();level++) {
+    setKernelLevel((KernelLevel)level);
+    vector<unsigned char> box_hit(n_bricks, 0), near(n_bullets);
+    double t, boxes, mirrors, grid_time;
+    int runs = 20;
+
+    t = benchNow();
+    for(int r=0;r<runs;r++)
+      for(j=0;j<n_bullets;j++)
+        legHitsBoxes(paths.x[j], paths.y[j], paths.half_dx[j], paths.half_dy[j], radius[j],
+                     &cx[0], &cy[0], &hw[0], &hh[0], n_bricks, &box_hit[0]);
+    boxes = (benchNow()-t)/runs/((double)n_bricks*n_bullets)*1e9;
+    t = benchNow();
+    for(int r=0;r<runs*100;r++)
+      legsNearMirrors(&x0[0], &y0[0], &x1[0], &y1[0], &radius[0], n_bullets,
+                      mx, my, ux, uy, mw, mt, game.total_mirrors, &near[0]);
+    mirrors = (benchNow()-t)/(runs*100)/n_bullets*1e9;
+    t = benchNow();
+    for(int r=0;r<runs;r++)
+      findBrickHitsGrid(grid, bricks, paths, grid_hits);
+    grid_time = (benchNow()-t)/runs*1e6;
+
+    printf("%-8s %16.4f %16.3f %9.1f\n", kernelLevelName((KernelLevel)level), boxes, mirrors, grid_time);
+    if(box_hit != box_ref) {
+      printf("  box kernel disagrees with scalar\n");
+      failed = 1;
+    }
+    if(near != near_ref) {
+      printf("  mirror kernel disagrees with scalar\n");
+      failed = 1;
+    }
+    if(grid_hits != brute_hits) {
+      printf("  grid found %d hits, brute force %d\n", (int)grid_hits.size(), (int)brute_hits.size());
+      failed = 1;
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,175 @@
+/* Brick and bullet storage - the array-of-structs classes the game used to have
+   against the pools in sim.h, on the two loops that run every tick.
+   Build with `make bench`, run as ./bench/layout_bench [bricks] [bullets] */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "scene.h"
+
+using namespace std;
+
+/* The old entity classes, hot and cold fields together */
+class BrickAoS {
+   public:
+      float x;
+      float y;
+      float y_shift;
+      float length;
+      float width;
+      bool status;
+      string color;
+      void *brickObj;
+};
+
+class BulletAoS {
+   public:
+      float x;
+      float y;
+      float x_shift;
+      float y_shift;
+      float vector_translate;
+      float rotate_angle;
+      float radius;
+      float x_laser_shift;
+      float y_laser_shift;
+      bool status;
+      bool reflected;
+};
+
+/* Same positions in both layouts, one brick in ten dead */
+void fill (Rng& rng, int n_bricks, int n_bullets, vector<BrickAoS>& aos_bricks, vector<BulletAoS>& aos_bullets,
+           BrickPool& bricks, BulletPool& bullets) {
+  const char* names[] = { "red", "green", "black" };
+  aos_bricks.resize(n_bricks);
+  aos_bullets.resize(n_bullets);
+  bricks.init(n_bricks);
+  bullets.init(n_bullets);
+  for(int i=0;i<n_bricks;i++) {
+    Color color = (Color)rng.below(3);
+    int slot = bricks.create(rng.uniform(-4, 4), color);
+    bricks.y[slot] = rng.uniform(-4, 4);
+    BrickAoS& b = aos_bricks[i];
+    b.x = bricks.x[slot];
+    b.y = bricks.y[slot];
+    b.y_shift = 0;
+    b.length = bricks.length[slot];
+    b.width = bricks.width[slot];
+    b.status = 1;
+    b.color = names[color];
+    b.brickObj = NULL;
+    if(i%10 == 9) {
+      bricks.vanish(slot);
+      b.status = 0;
+    }
+  }
+  for(int i=0;i<n_bullets;i++) {
+    int slot = bullets.create(0);
+    bullets.x[slot] = rng.uniform(-4, 4);
+    bullets.y[slot] = rng.uniform(-4, 4);
+    BulletAoS& b = aos_bullets[i];
+    b.x = bullets.x[slot];
+    b.y = bullets.y[slot];
+    b.radius = bullets.radius[slot];
+    b.status = 1;
+  }
+}
+
+void fallAoS (vector<BrickAoS>& bricks, float speed) {
+  for(int i=0;i<(int)bricks.size();i++) {
+    bricks[i].y_shift -= speed;
+    bricks[i].y -= speed;
+  }
+}
+
+void fallSoA (BrickPool& bricks, float speed) {
+  for(int i=0;i<bricks.count;i++) {
+    bricks.prev_y[i] = bricks.y[i];
+    bricks.y[i] -= speed;
+  }
+}
+
+/* checkBrickBulletCollision without the vanish, so every run sees the same bricks */
+int collideAoS (const vector<BrickAoS>& bricks, const vector<BulletAoS>& bullets) {
+  int hits = 0;
+  for(int i=0;i<(int)bricks.size();i++) {
+    if(!bricks[i].status)
+      continue;
+    float y_brick_center = bricks[i].y - (bricks[i].length/2);
+    float x_brick_center = bricks[i].x - (bricks[i].width/2);
+    for(int j=0;j<(int)bullets.size();j++) {
+      if(!bullets[j].status)
+        continue;
+      float x_axis_check = (bricks[i].width/2) + bullets[j].radius;
+      float y_axis_check = (bricks[i].length/2) + bullets[j].radius;
+      if(fabs(y_brick_center-bullets[j].y)<=y_axis_check&&fabs(x_brick_center-bullets[j].x)<=x_axis_check) {
+        hits++;
+        break;
+      }
+    }
+  }
+  return hits;
+}
+
+int collideSoA (const BrickPool& bricks, const BulletPool& bullets) {
+  const float *x_bullet = &bullets.x[0], *y_bullet = &bullets.y[0], *radius = &bullets.radius[0];
+  int hits = 0;
+  for(int k=0;k<bricks.live.size();k++) {
+    int i = bricks.live.dense[k];
+    float half_width = bricks.width[i]/2, half_length = bricks.length[i]/2;
+    float y_brick_center = bricks.y[i] - half_length;
+    float x_brick_center = bricks.x[i] - half_width;
+    int hit = 0;
+    for(int j=0;j<bullets.count;j++)
+      hit |= (fabsf(y_brick_center-y_bullet[j])<=half_length+radius[j]) & (fabsf(x_brick_center-x_bullet[j])<=half_width+radius[j]);
+    hits += hit;
+  }
+  return hits;
+}
+
+int main (int argc, char** argv) {
+  int n_bricks = argc>1 ? atoi(argv[1]) : 100000;
+  int n_bullets = argc>2 ? atoi(argv[2]) : 1000;
+  vector<BrickAoS> aos_bricks;
+  vector<BulletAoS> aos_bullets;
+  BrickPool bricks;
+  BulletPool bullets;
+  Rng rng;
+
+  rng.seed(1);
+  fill(rng, n_bricks, n_bullets, aos_bricks, aos_bullets, bricks, bullets);
+  printf("%d bricks (%d bytes each as AoS), %d bullets\n", n_bricks, (int)sizeof(BrickAoS), n_bullets);
+
+  int fall_runs = 200, collide_runs = 5;
+  double t, aos, soa;
+
+  t = benchNow();
+  for(int r=0;r<fall_runs;r++)
+    fallAoS(aos_bricks, 0.005);
+  aos = (benchNow()-t)/fall_runs/n_bricks*1e9;
+  t = benchNow();
+  for(int r=0;r<fall_runs;r++)
+    fallSoA(bricks, 0.005);
+  soa = (benchNow()-t)/fall_runs/n_bricks*1e9;
+  printf("fall     AoS %7.3f ns/brick  SoA %7.3f ns/brick  x%.2f\n", aos, soa, aos/soa);
+
+  int aos_hits = 0, soa_hits = 0;
+  t = benchNow();
+  for(int r=0;r<collide_runs;r++)
+    aos_hits += collideAoS(aos_bricks, aos_bullets);
+  aos = (benchNow()-t)/collide_runs/n_bricks*1e9;
+  t = benchNow();
+  for(int r=0;r<collide_runs;r++)
+    soa_hits += collideSoA(bricks, bullets);
+  soa = (benchNow()-t)/collide_runs/n_bricks*1e9;
+  printf("collide  AoS %7.1f ns/brick  SoA %7.1f ns/brick  x%.2f\n", aos, soa, aos/soa);
+
+  if(aos_hits != soa_hits) {
+    printf("layouts disagree: %d hits against %d\n", aos_hits, soa_hits);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,68 @@
+/* The frontend on the same seeded scenes as sim_bench - LoadShaders at startup
+   and the CPU time draw() takes to submit a frame on each render path. Opens a
+   hidden window for a GL 3.3 context.
+   Build with `make bench-gl`, run from src (the shaders are loaded from there)
+   as ./bench/render_bench [--json path] [--seed n] - initGL prints the GL
+   strings to stdout first, so pass --json for a clean results file */
+
+#define CRAZYBRICKS_NO_MAIN
+#include "../Sample_GL3_2D.cpp"
+
+#include "scene.h"
+
+#define SHADER_RUNS 20
+#define DRAW_RUNS 50
+
+int main (int argc, char** argv)
+{
+  const char* json_path = NULL;
+  unsigned seed = 1;
+  vector<BenchResult> results;
+  static const char* path_names[RENDER_PATHS] = { "draw per object", "draw instanced", "draw streamed" };
+  int s, p, r;
+
+  parseBenchArgs(argc, argv, json_path, seed);
+  width = 1000;
+  height = 600;
+  swap_interval = 0;
+  glfwInit();
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  GLFWwindow* window = initGLFW(width, height);
+  initGL(window, width, height);
+
+  // Compile and link from source, as initGL does for each program
+  double total = 0;
+  for(r=0;r<SHADER_RUNS;r++) {
+    double t = benchNow();
+    GLuint program = LoadShaders("Sample_GL.vert", "Sample_GL.frag");
+    total += benchNow()-t;
+    glDeleteProgram(program);
+  }
+  BenchResult shaders = { "LoadShaders", 0, SHADER_RUNS, total/SHADER_RUNS*1e9 };
+  results.push_back(shaders);
+
+  for(s=0;s<SCENE_SIZES;s++) {
+    makeScene(game, scene_sizes[s], seed);
+    for(p=0;p<RENDER_PATHS;p++) {
+      render_path = p;
+      draw(0.5);
+      glFinish();
+      // Only the submit is timed - the GPU catches up outside the timed region. Not quite on
+      // a driver that renders at glFenceSync, like Mesa's llvmpipe: there the streamed path's
+      // time takes in drawing the frame, as fenceStream() is part of draw()
+      total = 0;
+      for(r=0;r<DRAW_RUNS;r++) {
+        double t = benchNow();
+        draw(0.5);
+        total += benchNow()-t;
+        glFinish();
+      }
+      BenchResult frame = { path_names[p], scene_sizes[s], DRAW_RUNS, total/DRAW_RUNS*1e9 };
+      results.push_back(frame);
+    }
+  }
+
+  gpu_resources.context_alive = 0;
+  glfwTerminate();
+  return writeResults(json_path, "render_bench", seed, results) ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#ifndef CRAZYBRICKS_BENCH_SCENE_H
+#define CRAZYBRICKS_BENCH_SCENE_H
+
+/* Shared by the benchmark suite - seeded scenes, a clock and JSON results */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "sim.h"
+
+/* The scene sizes every suite bench runs */
+static const int scene_sizes[] = { 100, 1000, 10000, 100000 };
+#define SCENE_SIZES (int)(sizeof(scene_sizes)/sizeof(scene_sizes[0]))
+
+static double benchNow () {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* A game mid-play with this many entities, 49 bricks to every bullet - any more
+   bullets and at 100k they sweep the whole playfield in a tick. The same seed
+   always gives the same scene. */
+static void makeScene (Game& game, int entities, unsigned seed) {
+  int n_bullets = std::max(1, entities/50), n_bricks = entities-n_bullets;
+
+  // Drawn from the game's own stream, so a scene is the same on every platform
+  initGame(game, seed);
+  Rng& rng = game.rng;
+  for(int i=0;i<n_bricks;i++) {
+    int slot = game.bricks.create(rng.uniform(-3.9, 3.9), (Color)rng.below(3));
+    game.bricks.y[slot] = game.bricks.prev_y[slot] = rng.uniform(-2.5, 3.8);
+  }
+  // Bullets already in flight from wherever they last bounced
+  BulletPool& bullets = game.bullets;
+  for(int i=0;i<n_bullets;i++) {
+    int slot = bullets.create(rng.uniform(-180, 180));
+    float angle = bullets.rotate_angle[slot]*M_PI/180.0f;
+    bullets.reflected[slot] = 1;
+    bullets.x_laser_shift[slot] = rng.uniform(-4, 4);
+    bullets.y_laser_shift[slot] = rng.uniform(-4, 4);
+    bullets.vector_translate[slot] = game.bullet_speed;
+    bullets.x[slot] = bullets.x_laser_shift[slot]+game.bullet_speed*cos(angle);
+    bullets.y[slot] = bullets.y_laser_shift[slot]+game.bullet_speed*sin(angle);
+  }
+  // Legs for the brick check, as if the tick had got that far
+  moveBullets(game, 1);
+}
+
+/* One timing per line of the results file */
+struct BenchResult {
+    std::string name;
+    int entities;
+    int runs;
+    double ns_per_run;
+};
+
+/* {"bench": ..., "seed": ..., "threads": ..., "results": [{"name": ..., "entities": ..., "runs": ..., "ns": ...}, ...]}
+   to path, or stdout when path is NULL */
+static bool writeResults (const char* path, const char* bench, unsigned seed, const std::vector<BenchResult>& results,
+                          int threads = 1) {
+  FILE* out = path ? fopen(path, "w") : stdout;
+  if(!out) {
+    perror(path);
+    return false;
+  }
+  fprintf(out, "{\n  \"bench\": \"%s\",\n  \"seed\": %u,\n  \"threads\": %d,\n  \"results\": [\n", bench, seed, threads);
+  for(int i=0;i<(int)results.size();i++)
+    fprintf(out, "    {\"name\": \"%s\", \"entities\": %d, \"runs\": %d, \"ns\": %.1f}%s\n",
+      results[i].name.c_str(), results[i].entities, results[i].runs, results[i].ns_per_run,
+      i+1<(int)results.size() ? "," : "");
+  fprintf(out, "  ]\n}\n");
+  if(path)
+    fclose(out);
+  return true;
+}
+
+/* --json <path> and --seed <n> */
+static void parseBenchArgs (int argc, char** argv, const char*& json_path, unsigned& seed) {
+  for(int i=1;i+1<argc;i++) {
+    if(!strcmp(argv[i], "--json"))
+      json_path = argv[++i];
+    else if(!strcmp(argv[i], "--seed"))
+      seed = (unsigned)strtoul(argv[++i], NULL, 10);
+  }
+}
+
+#endif
@@ -0,0 +1,114 @@
+/* The simulation pipeline on seeded scenes of 100 to 100k entities - each
+   check step() runs, step() as a whole, entity creation, and snapshots. Results go out
+   as JSON so runs can be compared across releases.
+   --threads n runs step() on that many job threads (see jobs.h).
+   Build with `make bench`, run as ./bench/sim_bench [--json path] [--seed n] [--threads n] */
+
+#include "jobs.h"
+#include "scene.h"
+#include "snapshot.h"
+
+using namespace std;
+
+typedef void (*Check) (Game& game);
+
+static void moveBulletsTick (Game& game) {
+  moveBullets(game, 1);
+}
+
+static void stepTick (Game& game) {
+  Inputs inputs;
+  clearInputs(inputs);
+  inputs.cursor_x = 0;
+  inputs.cursor_y = 0;
+  step(game, SIM_TICK, inputs);
+}
+
+/* In the order step() calls them */
+static const struct { const char* name; Check check; } checks[] = {
+  { "moveBullets", moveBulletsTick },
+  { "checkRedBasket", checkRedBasket },
+  { "checkGreenBasket", checkGreenBasket },
+  { "checkBrickBulletCollision", checkBrickBulletCollision },
+  { "checkBulletOutOfWindow", checkBulletOutOfWindow },
+  { "checkBrickYLimit", checkBrickYLimit },
+  { "checkLevel", checkLevel },
+  { "step", stepTick },
+};
+
+/* About the same total work at every size */
+static int runsFor (int entities) {
+  return max(5, min(20000, 2000000/entities));
+}
+
+int main (int argc, char** argv) {
+  const char* json_path = NULL;
+  unsigned seed = 1;
+  vector<BenchResult> results;
+  Game scene, work;
+  GameSnapshot snapshot;
+  int s, c, r, i;
+
+  parseBenchArgs(argc, argv, json_path, seed);
+  for(i=1;i+1<argc;i++)
+    if(!strcmp(argv[i], "--threads"))
+      setJobThreads(atoi(argv[++i]));
+  snapshot.init();
+  for(s=0;s<SCENE_SIZES;s++) {
+    int entities = scene_sizes[s], runs = runsFor(entities);
+    makeScene(scene, entities, seed);
+
+    // Each run starts from the same scene, the copy is not timed
+    for(c=0;c<(int)(sizeof(checks)/sizeof(checks[0]));c++) {
+      double total = 0;
+      for(r=0;r<runs;r++) {
+        work = scene;
+        double t = benchNow();
+        checks[c].check(work);
+        total += benchNow()-t;
+      }
+      BenchResult result = { checks[c].name, entities, runs, total/runs*1e9 };
+      results.push_back(result);
+    }
+
+    // Creation, per entity, into pools already big enough
+    int create_runs = max(3, runs/100);
+    double brick_total = 0, bullet_total = 0;
+    for(r=0;r<create_runs;r++) {
+      BrickPool bricks;
+      BulletPool bullets;
+      bricks.init(entities);
+      bullets.init(entities);
+      double t = benchNow();
+      for(i=0;i<entities;i++)
+        bricks.create(0, (Color)(i%COLOR_COUNT));
+      brick_total += benchNow()-t;
+      t = benchNow();
+      for(i=0;i<entities;i++)
+        bullets.create(0);
+      bullet_total += benchNow()-t;
+    }
+    BenchResult brick_create = { "BrickPool::create", entities, create_runs, brick_total/create_runs/entities*1e9 };
+    BenchResult bullet_create = { "BulletPool::create", entities, create_runs, bullet_total/create_runs/entities*1e9 };
+    results.push_back(brick_create);
+    results.push_back(bullet_create);
+
+    // Save and restore, warmed up once so neither side allocates
+    double save_total = 0, restore_total = 0;
+    work = scene;
+    snapshot.save(scene);
+    for(r=0;r<runs;r++) {
+      double t = benchNow();
+      snapshot.save(scene);
+      save_total += benchNow()-t;
+      t = benchNow();
+      snapshot.restore(work);
+      restore_total += benchNow()-t;
+    }
+    BenchResult save = { "GameSnapshot::save", entities, runs, save_total/runs*1e9 };
+    BenchResult restore = { "GameSnapshot::restore", entities, runs, restore_total/runs*1e9 };
+    results.push_back(save);
+    results.push_back(restore);
+  }
+  return writeResults(json_path, "sim_bench", seed, results, jobThreads()) ? 0 : 1;
+}
@@ -0,0 +1,261 @@
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+#include "collide.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/* Lets a leg that only grazes a mirror box through rounding still reach the exact sweep */
+#define MIRROR_SLACK 1e-4f
+
+/**********
+ * Scalar *
+ **********/
+
+/* Reference versions, over [k, n) so the wide ones can hand them their tails */
+
+static void legHitsBoxesScalar (float x, float y, float half_dx, float half_dy, float r,
+                                const float* cx, const float* cy, const float* half_width, const float* half_length,
+                                int k, int n, unsigned char* hit) {
+  float hx = fabsf(half_dx), hy = fabsf(half_dy);
+  for(;k<n;k++) {
+    float mx = x-cx[k], my = y-cy[k];
+    float ex = half_width[k]+r, ey = half_length[k]+r;
+    hit[k] |= (fabsf(mx)<=ex+hx) & (fabsf(my)<=ey+hy) &
+              (fabsf(mx*half_dy-my*half_dx)<=ex*hy+ey*hx);
+  }
+}
+
+static void legsNearMirrorsScalar (const float* x0, const float* y0, const float* x1, const float* y1,
+                                   const float* radius, int j, int n,
+                                   const float* cx, const float* cy, const float* ux, const float* uy,
+                                   const float* half_width, const float* thick, int m,
+                                   unsigned char* near) {
+  for(;j<n;j++) {
+    unsigned char any = 0;
+    for(int i=0;i<m;i++) {
+      float reach = radius[j]+thick[i]+MIRROR_SLACK, span = half_width[i]+reach;
+      float px0 = x0[j]-cx[i], py0 = y0[j]-cy[i], px1 = x1[j]-cx[i], py1 = y1[j]-cy[i];
+      // Across the mirror and along it, at both ends of the leg
+      float s0 = py0*ux[i]-px0*uy[i], s1 = py1*ux[i]-px1*uy[i];
+      float a0 = px0*ux[i]+py0*uy[i], a1 = px1*ux[i]+py1*uy[i];
+      any |= ((s0<s1 ? s0 : s1)<=reach) & ((s0>s1 ? s0 : s1)>=-reach) &
+             ((a0<a1 ? a0 : a1)<=span) & ((a0>a1 ? a0 : a1)>=-span);
+    }
+    near[j] = any;
+  }
+}
+
+#ifdef X86_KERNELS
+
+/*******
+ * SSE *
+ *******/
+
+__attribute__((target("sse2")))
+static void legHitsBoxesSSE (float x, float y, float half_dx, float half_dy, float r,
+                             const float* cx, const float* cy, const float* half_width, const float* half_length,
+                             int n, unsigned char* hit) {
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  __m128 vx = _mm_set1_ps(x), vy = _mm_set1_ps(y), vr = _mm_set1_ps(r);
+  __m128 vdx = _mm_set1_ps(half_dx), vdy = _mm_set1_ps(half_dy);
+  __m128 vhx = _mm_set1_ps(fabsf(half_dx)), vhy = _mm_set1_ps(fabsf(half_dy));
+  int k = 0;
+  for(;k+4<=n;k+=4) {
+    __m128 mx = _mm_sub_ps(vx, _mm_loadu_ps(cx+k)), my = _mm_sub_ps(vy, _mm_loadu_ps(cy+k));
+    __m128 ex = _mm_add_ps(_mm_loadu_ps(half_width+k), vr), ey = _mm_add_ps(_mm_loadu_ps(half_length+k), vr);
+    __m128 in = _mm_and_ps(_mm_cmple_ps(_mm_andnot_ps(sign, mx), _mm_add_ps(ex, vhx)),
+                           _mm_cmple_ps(_mm_andnot_ps(sign, my), _mm_add_ps(ey, vhy)));
+    __m128 cross = _mm_andnot_ps(sign, _mm_sub_ps(_mm_mul_ps(mx, vdy), _mm_mul_ps(my, vdx)));
+    in = _mm_and_ps(in, _mm_cmple_ps(cross, _mm_add_ps(_mm_mul_ps(ex, vhy), _mm_mul_ps(ey, vhx))));
+    // Lane masks narrowed to 0/1 bytes and or'ed into hit four at a time
+    __m128i lanes = _mm_castps_si128(in);
+    lanes = _mm_packs_epi16(_mm_packs_epi32(lanes, lanes), lanes);
+    uint32_t bytes;
+    memcpy(&bytes, hit+k, 4);
+    bytes |= (uint32_t)_mm_cvtsi128_si32(lanes) & 0x01010101u;
+    memcpy(hit+k, &bytes, 4);
+  }
+  legHitsBoxesScalar(x, y, half_dx, half_dy, r, cx, cy, half_width, half_length, k, n, hit);
+}
+
+__attribute__((target("sse2")))
+static void legsNearMirrorsSSE (const float* x0, const float* y0, const float* x1, const float* y1,
+                                const float* radius, int n,
+                                const float* cx, const float* cy, const float* ux, const float* uy,
+                                const float* half_width, const float* thick, int m,
+                                unsigned char* near) {
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  int j = 0;
+  for(;j+4<=n;j+=4) {
+    __m128 lx0 = _mm_loadu_ps(x0+j), ly0 = _mm_loadu_ps(y0+j);
+    __m128 lx1 = _mm_loadu_ps(x1+j), ly1 = _mm_loadu_ps(y1+j), lr = _mm_loadu_ps(radius+j);
+    __m128 any = _mm_setzero_ps();
+    for(int i=0;i<m;i++) {
+      __m128 vux = _mm_set1_ps(ux[i]), vuy = _mm_set1_ps(uy[i]);
+      __m128 reach = _mm_add_ps(_mm_add_ps(lr, _mm_set1_ps(thick[i])), _mm_set1_ps(MIRROR_SLACK));
+      __m128 span = _mm_add_ps(_mm_set1_ps(half_width[i]), reach);
+      __m128 px0 = _mm_sub_ps(lx0, _mm_set1_ps(cx[i])), py0 = _mm_sub_ps(ly0, _mm_set1_ps(cy[i]));
+      __m128 px1 = _mm_sub_ps(lx1, _mm_set1_ps(cx[i])), py1 = _mm_sub_ps(ly1, _mm_set1_ps(cy[i]));
+      __m128 s0 = _mm_sub_ps(_mm_mul_ps(py0, vux), _mm_mul_ps(px0, vuy));
+      __m128 s1 = _mm_sub_ps(_mm_mul_ps(py1, vux), _mm_mul_ps(px1, vuy));
+      __m128 a0 = _mm_add_ps(_mm_mul_ps(px0, vux), _mm_mul_ps(py0, vuy));
+      __m128 a1 = _mm_add_ps(_mm_mul_ps(px1, vux), _mm_mul_ps(py1, vuy));
+      __m128 in = _mm_and_ps(_mm_cmple_ps(_mm_min_ps(s0, s1), reach),
+                             _mm_cmpge_ps(_mm_max_ps(s0, s1), _mm_xor_ps(reach, sign)));
+      in = _mm_and_ps(in, _mm_and_ps(_mm_cmple_ps(_mm_min_ps(a0, a1), span),
+                                     _mm_cmpge_ps(_mm_max_ps(a0, a1), _mm_xor_ps(span, sign))));
+      any = _mm_or_ps(any, in);
+    }
+    int bits = _mm_movemask_ps(any);
+    for(int b=0;b<4;b++)
+      near[j+b] = (bits>>b)&1;
+  }
+  legsNearMirrorsScalar(x0, y0, x1, y1, radius, j, n, cx, cy, ux, uy, half_width, thick, m, near);
+}
+
+/********
+ * AVX2 *
+ ********/
+
+__attribute__((target("avx2")))
+static void legHitsBoxesAVX2 (float x, float y, float half_dx, float half_dy, float r,
+                              const float* cx, const float* cy, const float* half_width, const float* half_length,
+                              int n, unsigned char* hit) {
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 vx = _mm256_set1_ps(x), vy = _mm256_set1_ps(y), vr = _mm256_set1_ps(r);
+  __m256 vdx = _mm256_set1_ps(half_dx), vdy = _mm256_set1_ps(half_dy);
+  __m256 vhx = _mm256_set1_ps(fabsf(half_dx)), vhy = _mm256_set1_ps(fabsf(half_dy));
+  int k = 0;
+  for(;k+8<=n;k+=8) {
+    __m256 mx = _mm256_sub_ps(vx, _mm256_loadu_ps(cx+k)), my = _mm256_sub_ps(vy, _mm256_loadu_ps(cy+k));
+    __m256 ex = _mm256_add_ps(_mm256_loadu_ps(half_width+k), vr);
+    __m256 ey = _mm256_add_ps(_mm256_loadu_ps(half_length+k), vr);
+    __m256 in = _mm256_and_ps(_mm256_cmp_ps(_mm256_andnot_ps(sign, mx), _mm256_add_ps(ex, vhx), _CMP_LE_OQ),
+                              _mm256_cmp_ps(_mm256_andnot_ps(sign, my), _mm256_add_ps(ey, vhy), _CMP_LE_OQ));
+    __m256 cross = _mm256_andnot_ps(sign, _mm256_sub_ps(_mm256_mul_ps(mx, vdy), _mm256_mul_ps(my, vdx)));
+    in = _mm256_and_ps(in, _mm256_cmp_ps(cross, _mm256_add_ps(_mm256_mul_ps(ex, vhy), _mm256_mul_ps(ey, vhx)), _CMP_LE_OQ));
+    __m128i lanes = _mm_packs_epi32(_mm256_castsi256_si128(_mm256_castps_si256(in)),
+                                    _mm256_extracti128_si256(_mm256_castps_si256(in), 1));
+    lanes = _mm_and_si128(_mm_packs_epi16(lanes, lanes), _mm_set1_epi8(1));
+    __m128i* dst = (__m128i*)(hit+k);
+    _mm_storel_epi64(dst, _mm_or_si128(_mm_loadl_epi64(dst), lanes));
+  }
+  legHitsBoxesScalar(x, y, half_dx, half_dy, r, cx, cy, half_width, half_length, k, n, hit);
+}
+
+__attribute__((target("avx2")))
+static void legsNearMirrorsAVX2 (const float* x0, const float* y0, const float* x1, const float* y1,
+                                 const float* radius, int n,
+                                 const float* cx, const float* cy, const float* ux, const float* uy,
+                                 const float* half_width, const float* thick, int m,
+                                 unsigned char* near) {
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  int j = 0;
+  for(;j+8<=n;j+=8) {
+    __m256 lx0 = _mm256_loadu_ps(x0+j), ly0 = _mm256_loadu_ps(y0+j);
+    __m256 lx1 = _mm256_loadu_ps(x1+j), ly1 = _mm256_loadu_ps(y1+j), lr = _mm256_loadu_ps(radius+j);
+    __m256 any = _mm256_setzero_ps();
+    for(int i=0;i<m;i++) {
+      __m256 vux = _mm256_set1_ps(ux[i]), vuy = _mm256_set1_ps(uy[i]);
+      __m256 reach = _mm256_add_ps(_mm256_add_ps(lr, _mm256_set1_ps(thick[i])), _mm256_set1_ps(MIRROR_SLACK));
+      __m256 span = _mm256_add_ps(_mm256_set1_ps(half_width[i]), reach);
+      __m256 px0 = _mm256_sub_ps(lx0, _mm256_set1_ps(cx[i])), py0 = _mm256_sub_ps(ly0, _mm256_set1_ps(cy[i]));
+      __m256 px1 = _mm256_sub_ps(lx1, _mm256_set1_ps(cx[i])), py1 = _mm256_sub_ps(ly1, _mm256_set1_ps(cy[i]));
+      __m256 s0 = _mm256_sub_ps(_mm256_mul_ps(py0, vux), _mm256_mul_ps(px0, vuy));
+      __m256 s1 = _mm256_sub_ps(_mm256_mul_ps(py1, vux), _mm256_mul_ps(px1, vuy));
+      __m256 a0 = _mm256_add_ps(_mm256_mul_ps(px0, vux), _mm256_mul_ps(py0, vuy));
+      __m256 a1 = _mm256_add_ps(_mm256_mul_ps(px1, vux), _mm256_mul_ps(py1, vuy));
+      __m256 in = _mm256_and_ps(_mm256_cmp_ps(_mm256_min_ps(s0, s1), reach, _CMP_LE_OQ),
+                                _mm256_cmp_ps(_mm256_max_ps(s0, s1), _mm256_xor_ps(reach, sign), _CMP_GE_OQ));
+      in = _mm256_and_ps(in, _mm256_and_ps(_mm256_cmp_ps(_mm256_min_ps(a0, a1), span, _CMP_LE_OQ),
+                                           _mm256_cmp_ps(_mm256_max_ps(a0, a1), _mm256_xor_ps(span, sign), _CMP_GE_OQ)));
+      any = _mm256_or_ps(any, in);
+    }
+    int bits = _mm256_movemask_ps(any);
+    for(int b=0;b<8;b++)
+      near[j+b] = (bits>>b)&1;
+  }
+  legsNearMirrorsScalar(x0, y0, x1, y1, radius, j, n, cx, cy, ux, uy, half_width, thick, m, near);
+}
+
+#endif
+
+/************
+ * Dispatch *
+ ************/
+
+KernelLevel bestKernelLevel () {
+#ifdef X86_KERNELS
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    return KERNEL_AVX2;
+  if(__builtin_cpu_supports("sse2"))
+    return KERNEL_SSE;
+#endif
+  return KERNEL_SCALAR;
+}
+
+/* -1 until the first kernel call looks at the CPU. Job threads can make that
+   first call together, and all of them find the same level */
+static std::atomic<int> current_level(-1);
+
+KernelLevel kernelLevel () {
+  int level = current_level.load(std::memory_order_relaxed);
+  if(level<0) {
+    level = bestKernelLevel();
+    current_level.store(level, std::memory_order_relaxed);
+  }
+  return (KernelLevel)level;
+}
+
+void setKernelLevel (KernelLevel level) {
+  KernelLevel best = bestKernelLevel();
+  current_level.store(level<best ? level : best, std::memory_order_relaxed);
+}
+
+const char* kernelLevelName (KernelLevel level) {
+  static const char* names[KERNEL_LEVELS] = { "scalar", "sse", "avx2" };
+  return names[level];
+}
+
+void legHitsBoxes (float x, float y, float half_dx, float half_dy, float r,
+                   const float* cx, const float* cy, const float* half_width, const float* half_length,
+                   int n, unsigned char* hit) {
+  switch(kernelLevel()) {
+#ifdef X86_KERNELS
+    case KERNEL_AVX2:
+      legHitsBoxesAVX2(x, y, half_dx, half_dy, r, cx, cy, half_width, half_length, n, hit);
+      break;
+    case KERNEL_SSE:
+      legHitsBoxesSSE(x, y, half_dx, half_dy, r, cx, cy, half_width, half_length, n, hit);
+      break;
+#endif
+    default:
+      legHitsBoxesScalar(x, y, half_dx, half_dy, r, cx, cy, half_width, half_length, 0, n, hit);
+  }
+}
+
+void legsNearMirrors (const float* x0, const float* y0, const float* x1, const float* y1,
+                      const float* radius, int n,
+                      const float* cx, const float* cy, const float* ux, const float* uy,
+                      const float* half_width, const float* thick, int m,
+                      unsigned char* near) {
+  switch(kernelLevel()) {
+#ifdef X86_KERNELS
+    case KERNEL_AVX2:
+      legsNearMirrorsAVX2(x0, y0, x1, y1, radius, n, cx, cy, ux, uy, half_width, thick, m, near);
+      break;
+    case KERNEL_SSE:
+      legsNearMirrorsSSE(x0, y0, x1, y1, radius, n, cx, cy, ux, uy, half_width, thick, m, near);
+      break;
+#endif
+    default:
+      legsNearMirrorsScalar(x0, y0, x1, y1, radius, 0, n, cx, cy, ux, uy, half_width, thick, m, near);
+  }
+}
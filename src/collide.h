@@ -0,0 +1,38 @@
+#ifndef CRAZYBRICKS_COLLIDE_H
+#define CRAZYBRICKS_COLLIDE_H
+
+/* Batch collision kernels over SoA data. x86-64 builds carry SSE and AVX2
+   versions and pick the widest one the CPU has the first time a kernel runs;
+   anything else gets the scalar versions, which are also the reference the
+   others must agree with - see bench/kernel_bench. */
+
+enum KernelLevel {
+    KERNEL_SCALAR,
+    KERNEL_SSE,         // 4 lanes
+    KERNEL_AVX2,        // 8 lanes
+    KERNEL_LEVELS
+};
+
+KernelLevel bestKernelLevel ();         // widest level this CPU runs
+KernelLevel kernelLevel ();             // level in use
+void setKernelLevel (KernelLevel level);  // clamped to bestKernelLevel(), for benches
+const char* kernelLevelName (KernelLevel level);
+
+/* One bullet leg - midpoint (x,y), half its travel (half_dx,half_dy), radius r -
+   against n boxes given by centre and half extents, the same test as
+   sweptCircleHitsBox. Sets hit[k] for each box it touches, leaves the rest. */
+void legHitsBoxes (float x, float y, float half_dx, float half_dy, float r,
+                   const float* cx, const float* cy, const float* half_width, const float* half_length,
+                   int n, unsigned char* hit);
+
+/* n bullet legs from (x0,y0) to (x1,y1) against m mirrors - segments from
+   (cx,cy) half_width along the unit vector (ux,uy) each way, thickness thick.
+   near[j] is 1 if leg j enters the box around some mirror's capsule, 0 if it
+   cannot touch any of them. Conservative, sweepCircleCapsule decides. */
+void legsNearMirrors (const float* x0, const float* y0, const float* x1, const float* y1,
+                      const float* radius, int n,
+                      const float* cx, const float* cy, const float* ux, const float* uy,
+                      const float* half_width, const float* thick, int m,
+                      unsigned char* near);
+
+#endif
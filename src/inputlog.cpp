@@ -0,0 +1,221 @@
+#include <cstdio>
+#include <cstring>
+
+#include "inputlog.h"
+
+using namespace std;
+
+static const char input_log_magic[4] = { 'C', 'B', 'I', 'N' };
+
+/* Bits of the entry mask, in the order the fields are written */
+enum InputField {
+  FIELD_CURSOR_X,
+  FIELD_CURSOR_Y,
+  FIELD_SHOOT,
+  FIELD_SELECT_BASKET,
+  FIELD_LASER_MOVE,
+  FIELD_STICK_MOVE,
+  FIELD_BASKET_MOVE_0,
+  FIELD_BASKET_MOVE_1,
+  FIELD_SPEED_CHANGE,
+  FIELD_COUNT
+};
+
+/***********
+ * Varints *
+ ***********/
+
+/* Seven bits a byte, low first, high bit set on all but the last */
+static void putVarint (vector<unsigned char>& bytes, uint64_t v) {
+  while(v >= 0x80) {
+    bytes.push_back((unsigned char)(v|0x80));
+    v >>= 7;
+  }
+  bytes.push_back((unsigned char)v);
+}
+
+/* False at the end of the buffer or on a varint too long to be one of ours */
+static bool getVarint (const vector<unsigned char>& bytes, size_t& pos, uint64_t& v) {
+  v = 0;
+  for(int shift=0;shift<64;shift+=7) {
+    if(pos >= bytes.size())
+      return false;
+    unsigned char b = bytes[pos++];
+    v |= (uint64_t)(b&0x7f) << shift;
+    if(!(b&0x80))
+      return true;
+  }
+  return false;
+}
+
+static uint32_t zigzag (int32_t v) {
+  return ((uint32_t)v<<1) ^ (uint32_t)(v>>31);
+}
+
+static int32_t unzigzag (uint32_t v) {
+  return (int32_t)(v>>1) ^ -(int32_t)(v&1);
+}
+
+static uint32_t floatBits (float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, 4);
+  return bits;
+}
+
+static float bitsFloat (uint32_t bits) {
+  float f;
+  memcpy(&f, &bits, 4);
+  return f;
+}
+
+/* The press fields by mask bit, so both ends walk them the same way */
+static int* pressField (Inputs& inputs, int field) {
+  switch(field) {
+    case FIELD_SHOOT: return &inputs.shoot;
+    case FIELD_SELECT_BASKET: return &inputs.select_basket;
+    case FIELD_LASER_MOVE: return &inputs.laser_move;
+    case FIELD_STICK_MOVE: return &inputs.stick_move;
+    case FIELD_BASKET_MOVE_0: return &inputs.basket_move[0];
+    case FIELD_BASKET_MOVE_1: return &inputs.basket_move[1];
+    case FIELD_SPEED_CHANGE: return &inputs.speed_change;
+  }
+  return NULL;
+}
+
+/************
+ * Recorder *
+ ************/
+
+void InputRecorder::begin (uint64_t seed) {
+  this->bytes.assign(input_log_magic, input_log_magic+4);
+  putVarint(this->bytes, INPUT_LOG_VERSION);
+  putVarint(this->bytes, seed);
+  this->last_entry = 0;
+  this->cursor_x = floatBits(0);
+  this->cursor_y = floatBits(0);
+  this->finished = false;
+}
+
+void InputRecorder::record (uint32_t tick, const Inputs& inputs) {
+  uint32_t x = floatBits(inputs.cursor_x), y = floatBits(inputs.cursor_y), mask = 0;
+  Inputs presses = inputs;
+  int field;
+
+  if(x != this->cursor_x)
+    mask |= 1<<FIELD_CURSOR_X;
+  if(y != this->cursor_y)
+    mask |= 1<<FIELD_CURSOR_Y;
+  for(field=FIELD_SHOOT;field<FIELD_COUNT;field++)
+    if(*pressField(presses, field))
+      mask |= 1<<field;
+  if(!mask)
+    return;
+
+  putVarint(this->bytes, tick-this->last_entry);
+  putVarint(this->bytes, mask);
+  if(mask & (1<<FIELD_CURSOR_X))
+    putVarint(this->bytes, zigzag((int32_t)(x-this->cursor_x)));
+  if(mask & (1<<FIELD_CURSOR_Y))
+    putVarint(this->bytes, zigzag((int32_t)(y-this->cursor_y)));
+  for(field=FIELD_SHOOT;field<FIELD_COUNT;field++)
+    if(mask & (1<<field))
+      putVarint(this->bytes, zigzag(*pressField(presses, field)));
+  this->last_entry = tick;
+  this->cursor_x = x;
+  this->cursor_y = y;
+}
+
+void InputRecorder::finish (uint32_t ticks) {
+  if(this->finished)
+    return;
+  putVarint(this->bytes, ticks-this->last_entry);
+  putVarint(this->bytes, 0);
+  this->finished = true;
+}
+
+bool InputRecorder::save (const char* path) const {
+  FILE* file = fopen(path, "wb");
+  if(!file) {
+    perror(path);
+    return false;
+  }
+  bool ok = fwrite(&this->bytes[0], 1, this->bytes.size(), file) == this->bytes.size();
+  return (fclose(file) == 0) && ok;
+}
+
+/**********
+ * Player *
+ **********/
+
+bool InputPlayer::load (const char* path) {
+  FILE* file = fopen(path, "rb");
+  if(!file) {
+    perror(path);
+    return false;
+  }
+  unsigned char chunk[65536];
+  size_t n;
+  this->bytes.clear();
+  while((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    this->bytes.insert(this->bytes.end(), chunk, chunk+n);
+  fclose(file);
+  return this->rewind();
+}
+
+/* Back to tick 0 - false if this is not an input log we can read */
+bool InputPlayer::rewind () {
+  uint64_t version, delta, mask;
+  this->pos = 4;
+  if(this->bytes.size() < 4 || memcmp(&this->bytes[0], input_log_magic, 4) != 0)
+    return false;
+  if(!getVarint(this->bytes, this->pos, version) || version != INPUT_LOG_VERSION)
+    return false;
+  if(!getVarint(this->bytes, this->pos, this->seed))
+    return false;
+  if(!getVarint(this->bytes, this->pos, delta) || !getVarint(this->bytes, this->pos, mask))
+    return false;
+  this->next_entry = (uint32_t)delta;
+  this->next_mask = (uint32_t)mask;
+  this->cursor_x = floatBits(0);
+  this->cursor_y = floatBits(0);
+  clearInputs(this->inputs);
+  this->inputs.cursor_x = 0;
+  this->inputs.cursor_y = 0;
+  return true;
+}
+
+bool InputPlayer::next (uint32_t tick, Inputs& inputs) {
+  uint64_t v, delta, mask;
+  int field;
+
+  if(!this->next_mask && tick >= this->next_entry)
+    return false;
+  clearInputs(this->inputs);
+  if(tick == this->next_entry) {
+    if(this->next_mask & (1<<FIELD_CURSOR_X)) {
+      getVarint(this->bytes, this->pos, v);
+      this->cursor_x += (uint32_t)unzigzag((uint32_t)v);
+    }
+    if(this->next_mask & (1<<FIELD_CURSOR_Y)) {
+      getVarint(this->bytes, this->pos, v);
+      this->cursor_y += (uint32_t)unzigzag((uint32_t)v);
+    }
+    for(field=FIELD_SHOOT;field<FIELD_COUNT;field++)
+      if(this->next_mask & (1<<field)) {
+        getVarint(this->bytes, this->pos, v);
+        *pressField(this->inputs, field) = unzigzag((uint32_t)v);
+      }
+    this->inputs.cursor_x = bitsFloat(this->cursor_x);
+    this->inputs.cursor_y = bitsFloat(this->cursor_y);
+
+    // A cut-off file ends here
+    if(!getVarint(this->bytes, this->pos, delta) || !getVarint(this->bytes, this->pos, mask)) {
+      delta = 1;
+      mask = 0;
+    }
+    this->next_entry += (uint32_t)delta;
+    this->next_mask = (uint32_t)mask;
+  }
+  inputs = this->inputs;
+  return true;
+}
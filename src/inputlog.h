@@ -0,0 +1,50 @@
+#ifndef CRAZYBRICKS_INPUTLOG_H
+#define CRAZYBRICKS_INPUTLOG_H
+
+/* Recorded play sessions - the game's seed and what step() was given on each
+   tick, enough to replay the session exactly without a window.
+
+   File layout, all integers varints:
+     "CBIN" version seed
+     entries: ticks since the last entry, mask of the fields that follow, fields
+     end: ticks since the last entry, mask 0
+   A tick with no entry had no presses and the cursor where it was. Presses are
+   stored as they are (zigzag), cursor positions as the zigzag difference of
+   their float bits from the last position, which is small while the mouse is
+   still and replays the exact same floats. */
+
+#include <stdint.h>
+#include <vector>
+
+#include "sim.h"
+
+#define INPUT_LOG_VERSION 1
+
+struct InputRecorder {
+    std::vector<unsigned char> bytes;
+    uint32_t last_entry;                // tick of the last entry, or of begin()
+    uint32_t cursor_x, cursor_y;        // float bits
+    bool finished;
+
+    void begin (uint64_t seed);
+    void record (uint32_t tick, const Inputs& inputs);  // before step() gets them, ticks increasing
+    void finish (uint32_t ticks);       // ticks stepped in all
+    bool save (const char* path) const;
+};
+
+struct InputPlayer {
+    std::vector<unsigned char> bytes;
+    size_t pos;
+    uint64_t seed;
+    uint32_t next_entry;                // tick the next entry applies to
+    uint32_t next_mask;                 // its fields, 0 when it is the end
+    uint32_t cursor_x, cursor_y;        // float bits
+    Inputs inputs;
+
+    bool load (const char* path);       // false if the file is missing or not a log
+    bool rewind ();
+    // What step() got on this tick - call once per tick from 0 up, false past the end
+    bool next (uint32_t tick, Inputs& inputs);
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "jobs.h"
+
+using namespace std;
+
+#define MAX_JOB_THREADS 64
+
+struct Job {
+    JobFunction function;
+    void* data;
+    int index;
+    JobBatch* batch;
+};
+
+struct JobQueue {
+    mutex lock;
+    deque<Job> jobs;
+};
+
+/* Queue 0 belongs to whoever calls step(), the rest to the workers */
+static vector<JobQueue*> queues;
+static vector<thread> workers;
+static int threads = 1;
+static thread_local int own_queue = 0;
+
+// Workers sleep while nothing is queued anywhere
+static mutex sleep_lock;
+static condition_variable wake;
+static atomic<int> queued(0);
+static bool stopping = false;
+
+int hardwareThreads () {
+  return max(1, (int)thread::hardware_concurrency());
+}
+
+int jobThreads () {
+  return threads;
+}
+
+/* Newest from our own queue, else the oldest from the next one that has any */
+static bool takeJob (Job& job) {
+  int n = (int)queues.size();
+  for(int i=0;i<n;i++) {
+    JobQueue& queue = *queues[(own_queue+i)%n];
+    lock_guard<mutex> hold(queue.lock);
+    if(queue.jobs.empty())
+      continue;
+    if(i==0) {
+      job = queue.jobs.back();
+      queue.jobs.pop_back();
+    }
+    else {
+      job = queue.jobs.front();
+      queue.jobs.pop_front();
+    }
+    queued--;
+    return true;
+  }
+  return false;
+}
+
+static void runJob (Job& job) {
+  job.function(job.data, job.index);
+  job.batch->pending.fetch_sub(1, memory_order_acq_rel);
+}
+
+static void workerLoop (int queue) {
+  Job job;
+  own_queue = queue;
+  while(true) {
+    if(takeJob(job)) {
+      runJob(job);
+      continue;
+    }
+    unique_lock<mutex> hold(sleep_lock);
+    wake.wait(hold, [] { return stopping || queued.load()>0; });
+    if(stopping)
+      return;
+  }
+}
+
+void setJobThreads (int n) {
+  int i;
+  n = max(1, min(MAX_JOB_THREADS, n));
+  {
+    lock_guard<mutex> hold(sleep_lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for(i=0;i<(int)workers.size();i++)
+    workers[i].join();
+  workers.clear();
+  for(i=0;i<(int)queues.size();i++)
+    delete queues[i];
+  queues.clear();
+
+  stopping = false;
+  threads = n;
+  if(n==1)
+    return;
+  for(i=0;i<n;i++)
+    queues.push_back(new JobQueue);
+  for(i=1;i<n;i++)
+    workers.push_back(thread(workerLoop, i));
+}
+
+/* Threads still running at exit would take the process down with them */
+static struct JobPoolShutdown {
+    ~JobPoolShutdown () { setJobThreads(1); }
+} job_pool_shutdown;
+
+void submitJob (JobBatch& batch, JobFunction function, void* data, int index) {
+  batch.pending++;
+  Job job = { function, data, index, &batch };
+  if(threads==1) {
+    runJob(job);
+    return;
+  }
+  {
+    JobQueue& queue = *queues[own_queue];
+    lock_guard<mutex> hold(queue.lock);
+    queue.jobs.push_back(job);
+  }
+  queued++;
+  // Through the lock, so a worker between its check and its wait still hears this
+  {
+    lock_guard<mutex> hold(sleep_lock);
+  }
+  wake.notify_one();
+}
+
+void waitJobs (JobBatch& batch) {
+  Job job;
+  while(batch.pending.load(memory_order_acquire)>0) {
+    if(takeJob(job))
+      runJob(job);
+    else
+      this_thread::yield();
+  }
+}
+
+void runJobs (int count, JobFunction function, void* data) {
+  int i;
+  if(threads==1 || count<=1) {
+    for(i=0;i<count;i++)
+      function(data, i);
+    return;
+  }
+  JobBatch batch;
+  // Backwards, so we start on job 0 and the thieves take the far end
+  for(i=count-1;i>=0;i--)
+    submitJob(batch, function, data, i);
+  waitJobs(batch);
+}
@@ -0,0 +1,36 @@
+#ifndef CRAZYBRICKS_JOBS_H
+#define CRAZYBRICKS_JOBS_H
+
+/* A small work-stealing thread pool for the heavy phases of step(). Each
+   thread keeps its own queue, runs its newest job first and takes the oldest
+   from another queue when it runs dry. A thread waiting on a batch runs jobs
+   meanwhile, so batches can be started from inside jobs and one phase can
+   wait on the next while the pool stays busy.
+
+   Jobs only ever compute into storage of their own, indexed by job, and the
+   caller merges that in job order - the game comes out the same whatever the
+   thread count and whichever thread ran what. One thread, the default, runs
+   every job on the spot. */
+
+#include <atomic>
+
+typedef void (*JobFunction) (void* data, int index);
+
+/* Jobs that have to be done before something else can start */
+struct JobBatch {
+    std::atomic<int> pending;
+
+    JobBatch () : pending(0) {}
+};
+
+int hardwareThreads ();
+int jobThreads ();
+// Counting the thread that calls step(), clamped to 1..64 - not while jobs run
+void setJobThreads (int threads);
+
+void submitJob (JobBatch& batch, JobFunction function, void* data, int index);
+void waitJobs (JobBatch& batch);
+/* function(data, 0..count-1), back once all have run */
+void runJobs (int count, JobFunction function, void* data);
+
+#endif
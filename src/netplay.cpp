@@ -0,0 +1,486 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "netplay.h"
+
+using namespace std;
+
+static const char net_magic[4] = { 'C', 'B', 'N', 'P' };
+#define NET_VERSION 1
+#define NO_ROLLBACK 0xffffffffu
+#define NO_CLAIM 0xffffffffu
+/* Ticks ahead of the other side before waiting one out - the two advantages
+   each see the other late, so their difference is twice the real lead */
+#define NET_MAX_LEAD 2
+
+static double netNow () {
+  return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/***********
+ * Packets *
+ ***********/
+
+/* Little endian whatever the machine, so two builds can play */
+static void put8 (vector<unsigned char>& bytes, uint32_t v) {
+  bytes.push_back((unsigned char)v);
+}
+
+static void put32 (vector<unsigned char>& bytes, uint32_t v) {
+  for(int i=0;i<4;i++)
+    bytes.push_back((unsigned char)(v>>(8*i)));
+}
+
+static void put64 (vector<unsigned char>& bytes, uint64_t v) {
+  put32(bytes, (uint32_t)v);
+  put32(bytes, (uint32_t)(v>>32));
+}
+
+/* Reads past the end give 0 and set ok false */
+struct PacketReader {
+    const unsigned char* p;
+    size_t size, pos;
+    bool ok;
+
+    uint32_t get8 () {
+        if(pos+1 > size) { ok = false; return 0; }
+        return p[pos++];
+    }
+    uint32_t get32 () {
+        if(pos+4 > size) { ok = false; return 0; }
+        uint32_t v = p[pos] | p[pos+1]<<8 | p[pos+2]<<16 | (uint32_t)p[pos+3]<<24;
+        pos += 4;
+        return v;
+    }
+    uint64_t get64 () {
+        uint64_t lo = get32();
+        return lo | (uint64_t)get32()<<32;
+    }
+};
+
+static uint32_t floatBits (float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, 4);
+  return bits;
+}
+
+static float bitsFloat (uint32_t bits) {
+  float f;
+  memcpy(&f, &bits, 4);
+  return f;
+}
+
+/* Presses go as a byte each - a tick never has more than a handful */
+static int8_t pressByte (int n) {
+  return (int8_t)max(-128, min(127, n));
+}
+
+static void putInputs (vector<unsigned char>& bytes, const Inputs& inputs) {
+  put32(bytes, floatBits(inputs.cursor_x));
+  put32(bytes, floatBits(inputs.cursor_y));
+  put8(bytes, (uint8_t)pressByte(inputs.shoot));
+  put8(bytes, (uint8_t)pressByte(inputs.select_basket));
+  put8(bytes, (uint8_t)pressByte(inputs.laser_move));
+  put8(bytes, (uint8_t)pressByte(inputs.stick_move));
+  put8(bytes, (uint8_t)pressByte(inputs.basket_move[0]));
+  put8(bytes, (uint8_t)pressByte(inputs.basket_move[1]));
+  put8(bytes, (uint8_t)pressByte(inputs.speed_change));
+}
+
+static void getInputs (PacketReader& reader, Inputs& inputs) {
+  inputs.cursor_x = bitsFloat(reader.get32());
+  inputs.cursor_y = bitsFloat(reader.get32());
+  inputs.shoot = (int8_t)reader.get8();
+  inputs.select_basket = (int8_t)reader.get8();
+  inputs.laser_move = (int8_t)reader.get8();
+  inputs.stick_move = (int8_t)reader.get8();
+  inputs.basket_move[0] = (int8_t)reader.get8();
+  inputs.basket_move[1] = (int8_t)reader.get8();
+  inputs.speed_change = (int8_t)reader.get8();
+}
+
+static bool sameInputs (const Inputs& a, const Inputs& b) {
+  return floatBits(a.cursor_x)==floatBits(b.cursor_x) && floatBits(a.cursor_y)==floatBits(b.cursor_y) &&
+    a.shoot==b.shoot && a.select_basket==b.select_basket && a.laser_move==b.laser_move &&
+    a.stick_move==b.stick_move && a.basket_move[0]==b.basket_move[0] &&
+    a.basket_move[1]==b.basket_move[1] && a.speed_change==b.speed_change;
+}
+
+static void blankInputs (Inputs& inputs) {
+  clearInputs(inputs);
+  inputs.cursor_x = 0;
+  inputs.cursor_y = 0;
+}
+
+/*********
+ * Rules *
+ *********/
+
+void ownInputs (int player, Inputs& inputs) {
+  int basket_move = inputs.basket_move[0]+inputs.basket_move[1];
+  if(player==0) {
+    inputs.basket_move[0] = basket_move;
+    inputs.basket_move[1] = 0;
+  }
+  else {
+    blankInputs(inputs);
+    inputs.basket_move[1] = basket_move;
+  }
+}
+
+void mergeInputs (const Inputs& player0, const Inputs& player1, Inputs& merged) {
+  merged = player0;
+  merged.basket_move[1] = player1.basket_move[1];
+}
+
+/**********
+ * Socket *
+ **********/
+
+bool Netplay::open (int player, int local_port, const char* peer, int input_delay) {
+  string host = peer, port;
+  size_t colon = host.rfind(':');
+  struct addrinfo hints, *found;
+
+  this->player = player;
+  this->input_delay = max(0, input_delay);
+  this->connected = false;
+  this->running = false;
+  this->game = NULL;
+  this->sock = -1;
+  this->local_next = this->remote_next = this->remote_ack = 0;
+  this->peer_ticks = 0;
+  this->setShim(0, 0, 0, 1);
+
+  if(colon==string::npos) {
+    fprintf(stderr, "netplay: peer %s is not host:port\n", peer);
+    return false;
+  }
+  port = host.substr(colon+1);
+  host = host.substr(0, colon);
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  if(getaddrinfo(host.c_str(), port.c_str(), &hints, &found)!=0) {
+    fprintf(stderr, "netplay: cannot resolve %s\n", peer);
+    return false;
+  }
+  memcpy(&this->peer, found->ai_addr, found->ai_addrlen);
+  this->peer_len = found->ai_addrlen;
+  freeaddrinfo(found);
+
+  this->sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if(this->sock<0) {
+    perror("netplay: socket");
+    return false;
+  }
+  struct sockaddr_in local;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  local.sin_port = htons((uint16_t)local_port);
+  if(bind(this->sock, (struct sockaddr*)&local, sizeof(local))<0) {
+    perror("netplay: bind");
+    this->close();
+    return false;
+  }
+  fcntl(this->sock, F_SETFL, fcntl(this->sock, F_GETFL, 0)|O_NONBLOCK);
+  return true;
+}
+
+void Netplay::setShim (double latency_ms, double jitter_ms, float loss_percent, uint64_t seed) {
+  this->shim.latency = latency_ms/1000;
+  this->shim.jitter = jitter_ms/1000;
+  this->shim.loss = loss_percent/100;
+  this->shim.rng.seed(seed);
+}
+
+void Netplay::close () {
+  if(this->sock>=0)
+    ::close(this->sock);
+  this->sock = -1;
+  this->running = false;
+}
+
+/* Player 0 knocks until player 1 answers, player 1 waits for the knock and the seed in it */
+bool Netplay::connect (uint64_t& seed, double timeout) {
+  double start = netNow(), last_sent = 0;
+  this->seed = (this->player==0) ? seed : 0;
+  while(!this->connected && netNow()-start<timeout) {
+    if(this->player==0 && netNow()-last_sent>0.05) {
+      this->send();
+      last_sent = netNow();
+    }
+    this->receive();
+    this->flush();
+    usleep(1000);
+  }
+  if(!this->connected)
+    return false;
+  seed = this->seed;
+  if(this->player==1)
+    this->send();
+  return true;
+}
+
+void Netplay::flush () {
+  NetShim& shim = this->shim;
+  double now = netNow();
+  for(int i=0;i<(int)shim.packets.size();) {
+    if(shim.due[i]>now) {
+      i++;
+      continue;
+    }
+    sendto(this->sock, &shim.packets[i][0], shim.packets[i].size(), 0, (struct sockaddr*)&this->peer, this->peer_len);
+    shim.due[i] = shim.due.back();
+    shim.packets[i].swap(shim.packets.back());
+    shim.due.pop_back();
+    shim.packets.pop_back();
+  }
+}
+
+/* magic version player seed ticks advantage ack claim_tick claim_hash first count inputs... */
+void Netplay::send () {
+  vector<unsigned char> bytes;
+  uint32_t ticks = this->game ? this->game->ticks : 0, first = this->remote_ack, last = first, t;
+
+  bytes.assign(net_magic, net_magic+4);
+  put8(bytes, NET_VERSION);
+  put8(bytes, this->player);
+  put64(bytes, this->seed);
+  put32(bytes, ticks);
+  put32(bytes, (uint32_t)((int)ticks-(int)this->peer_ticks));
+  put32(bytes, this->remote_next);
+  if(this->running) {
+    t = this->confirmedTick();
+    put32(bytes, t);
+    put64(bytes, this->hashes[t]);
+    last = min(this->local_next, first+NET_INPUTS_PER_PACKET);
+  }
+  else {
+    put32(bytes, NO_CLAIM);
+    put64(bytes, 0);
+  }
+  put32(bytes, first);
+  put8(bytes, last-first);
+  for(t=first;t<last;t++)
+    putInputs(bytes, this->inputs[this->player][t]);
+
+  NetShim& shim = this->shim;
+  if(shim.latency>0 || shim.jitter>0 || shim.loss>0) {
+    if(shim.rng.uniform(0, 1)<shim.loss)
+      return;
+    shim.due.push_back(netNow()+shim.latency+shim.rng.uniform(0, 1)*shim.jitter);
+    shim.packets.push_back(bytes);
+    return;
+  }
+  sendto(this->sock, &bytes[0], bytes.size(), 0, (struct sockaddr*)&this->peer, this->peer_len);
+}
+
+void Netplay::receive () {
+  unsigned char buffer[2048];
+  int other = 1-this->player;
+  ssize_t n;
+
+  while((n = recv(this->sock, buffer, sizeof(buffer), 0))>0) {
+    PacketReader reader = { buffer, (size_t)n, 4, true };
+    if(n<4 || memcmp(buffer, net_magic, 4)!=0 || reader.get8()!=NET_VERSION || (int)reader.get8()!=other)
+      continue;
+    uint64_t seed = reader.get64();
+    uint32_t ticks = reader.get32();
+    int advantage = (int)reader.get32();
+    uint32_t ack = reader.get32();
+    uint32_t claim_tick = reader.get32();
+    uint64_t claim_hash = reader.get64();
+    uint32_t first = reader.get32(), count = reader.get8();
+    if(!reader.ok)
+      continue;
+    if(!this->connected) {
+      if(this->player==1)
+        this->seed = seed;
+      this->connected = true;
+    }
+    if(seed!=this->seed || !this->running)
+      continue;
+
+    this->peer_ticks = ticks;
+    this->peer_advantage = advantage;
+    this->remote_ack = max(this->remote_ack, ack);
+    if(claim_tick!=NO_CLAIM && (claim_tick>this->claim_tick || !this->claim_pending)) {
+      this->claim_tick = claim_tick;
+      this->claim_hash = claim_hash;
+      this->claim_pending = true;
+    }
+
+    for(uint32_t t=first;t<first+count;t++) {
+      Inputs inputs;
+      getInputs(reader, inputs);
+      // Never more than a packet's worth past what we have, whatever the packet says
+      if(!reader.ok || t>=this->remote_next+NET_INPUTS_PER_PACKET)
+        break;
+      this->ensure(t);
+      if(this->known[other][t])
+        continue;
+      this->inputs[other][t] = inputs;
+      this->known[other][t] = 1;
+      // Already played with a guess that turned out wrong
+      if(t<this->game->ticks && !sameInputs(this->used[t], inputs))
+        this->rollback_to = min(this->rollback_to, t);
+    }
+    while(this->remote_next<this->known[other].size() && this->known[other][this->remote_next])
+      this->remote_next++;
+  }
+}
+
+/************
+ * Rollback *
+ ************/
+
+void Netplay::ensure (uint32_t tick) {
+  if(tick<this->hashes.size())
+    return;
+  size_t size = max((size_t)tick+1, 2*this->hashes.size());
+  Inputs blank;
+  blankInputs(blank);
+  for(int p=0;p<2;p++) {
+    this->inputs[p].resize(size, blank);
+    this->known[p].resize(size, 0);
+  }
+  this->used.resize(size, blank);
+  this->hashes.resize(size, 0);
+}
+
+void Netplay::start (Game& game) {
+  uint32_t t;
+  this->game = &game;
+  this->ring.init(NET_WINDOW+1);
+  for(int p=0;p<2;p++) {
+    this->inputs[p].clear();
+    this->known[p].clear();
+  }
+  this->used.clear();
+  this->hashes.clear();
+  this->ensure(this->input_delay+NET_WINDOW);
+  // Nobody has pressed anything before the first inputs land
+  for(t=0;t<(uint32_t)this->input_delay;t++)
+    this->known[0][t] = this->known[1][t] = 1;
+  this->local_next = this->remote_next = this->remote_ack = this->input_delay;
+  this->rollback_to = NO_ROLLBACK;
+  this->peer_ticks = 0;
+  this->peer_advantage = 0;
+  this->claim_pending = false;
+  this->claim_tick = 0;
+  this->rollbacks = this->resimulated = this->stalls = this->desyncs = 0;
+  this->desync_tick = 0;
+  this->ring.save(game);
+  this->hashes[game.ticks] = hashGame(game);
+  this->running = true;
+}
+
+uint32_t Netplay::confirmedTick () const {
+  return min(this->remote_next, this->game->ticks);
+}
+
+bool Netplay::confirmed () const {
+  return this->game->ticks<=this->remote_next;
+}
+
+/* One tick with the inputs known now, or the guess for the other player's */
+void Netplay::simulate () {
+  Game& game = *this->game;
+  uint32_t t = game.ticks;
+  int other = 1-this->player;
+  Inputs both[2], merged;
+
+  this->ensure(t+1);
+  both[this->player] = this->inputs[this->player][t];
+  if(this->known[other][t])
+    both[other] = this->inputs[other][t];
+  else {
+    // Still where they were, pressing nothing
+    if(this->remote_next>0)
+      both[other] = this->inputs[other][this->remote_next-1];
+    else
+      blankInputs(both[other]);
+    clearInputs(both[other]);
+  }
+  this->used[t] = both[other];
+  mergeInputs(both[0], both[1], merged);
+  step(game, SIM_TICK, merged);
+  this->ring.save(game);
+  this->hashes[game.ticks] = hashGame(game);
+}
+
+/* Back to the first tick a late input changed, and forward again to where we were */
+void Netplay::rollBack () {
+  Game& game = *this->game;
+  uint32_t end = game.ticks;
+  if(!this->ring.restore(this->rollback_to, game)) {
+    fprintf(stderr, "netplay: tick %u is out of the snapshot ring\n", this->rollback_to);
+    abort();
+  }
+  this->rollbacks++;
+  this->resimulated += end-game.ticks;
+  while(game.ticks<end && !game.game_over)
+    this->simulate();
+  this->rollback_to = NO_ROLLBACK;
+}
+
+void Netplay::checkClaim () {
+  if(!this->claim_pending || this->claim_tick>this->confirmedTick())
+    return;
+  if(this->hashes[this->claim_tick]!=this->claim_hash) {
+    if(!this->desyncs)
+      this->desync_tick = this->claim_tick;
+    this->desyncs++;
+  }
+  this->claim_pending = false;
+}
+
+bool Netplay::advance (const Inputs& local) {
+  Game& game = *this->game;
+  this->flush();
+  this->receive();
+  if(this->rollback_to<game.ticks)
+    this->rollBack();
+  this->checkClaim();
+
+  // Wait rather than guess further than the ring reaches, or run away from the other side
+  int advantage = (int)game.ticks-(int)this->peer_ticks;
+  bool wait = game.game_over || game.ticks>=this->remote_next+NET_WINDOW ||
+    (this->peer_ticks>0 && advantage-this->peer_advantage>=2*NET_MAX_LEAD);
+  if(!wait) {
+    uint32_t t = game.ticks+this->input_delay;
+    this->ensure(t);
+    this->inputs[this->player][t] = local;
+    ownInputs(this->player, this->inputs[this->player][t]);
+    this->known[this->player][t] = 1;
+    this->local_next = t+1;
+  }
+  this->send();
+  this->flush();
+  if(wait) {
+    this->stalls++;
+    return false;
+  }
+  this->simulate();
+  return true;
+}
+
+void Netplay::finish (double timeout) {
+  double start = netNow();
+  while(this->remote_ack<this->local_next && netNow()-start<timeout) {
+    this->receive();
+    this->send();
+    this->flush();
+    usleep(16000);
+  }
+}
@@ -0,0 +1,101 @@
+#ifndef CRAZYBRICKS_NETPLAY_H
+#define CRAZYBRICKS_NETPLAY_H
+
+/* Two-player co-op over UDP. Player 0 has the laser, the mouse and the red
+   basket, player 1 the green basket, each on their own machine (or process)
+   running the whole simulation.
+
+   Each tick's local inputs are sent ahead and applied input_delay ticks later.
+   When the other player's inputs for a tick have not come yet they are
+   guessed - the last ones known, without presses - and the game carries on.
+   Once they do come and differ from the guess, the game goes back to that tick
+   from the snapshot ring and plays forward again, so local inputs show after
+   input_delay ticks whatever the round trip. A peer that gets NET_WINDOW ticks
+   past the last inputs it has waits.
+
+   Every packet carries all the inputs the other side has not acknowledged, so
+   a lost packet costs nothing, plus the hash of the latest tick the sender is
+   sure of, so a desync is noticed on the other side. NetShim holds outgoing
+   packets back to try latency, jitter and loss on one machine. */
+
+#include <stdint.h>
+#include <vector>
+#include <sys/socket.h>
+
+#include "sim.h"
+#include "snapshot.h"
+
+#define NET_WINDOW 64                   // ticks of rollback, and how far a peer may guess ahead
+#define NET_INPUTS_PER_PACKET 32
+#define NET_DEFAULT_INPUT_DELAY 1
+
+/* Outgoing packets held back by latency plus up to jitter seconds, and a share dropped */
+struct NetShim {
+    double latency, jitter;
+    float loss;
+    Rng rng;
+    std::vector<double> due;
+    std::vector<std::vector<unsigned char> > packets;
+};
+
+struct Netplay {
+    int player;                         // 0 or 1, the other one is 1-player
+    int input_delay;
+    int sock;
+    sockaddr_storage peer;
+    socklen_t peer_len;
+    uint64_t seed;                      // player 0's, player 1 takes it on connect()
+    bool connected, running;
+    NetShim shim;
+
+    Game* game;
+    SnapshotRing ring;
+    std::vector<Inputs> inputs[2];      // by tick, what each player controls
+    std::vector<unsigned char> known[2];
+    std::vector<Inputs> used;           // the other player's inputs each tick was last played with
+    std::vector<uint64_t> hashes;       // hashGame at each tick, final up to confirmedTick()
+    uint32_t local_next;                // first tick without local inputs yet
+    uint32_t remote_next;               // first tick without the other player's inputs yet
+    uint32_t remote_ack;                // first tick of ours the other side does not have
+    uint32_t rollback_to;               // earliest tick a late input changed, or none
+    uint32_t peer_ticks;                // where the other side was at its last packet
+    int peer_advantage;                 // how far it was ahead of us then, as it saw it
+    uint32_t claim_tick;                // the other side's hash of a tick not checked yet
+    uint64_t claim_hash;
+    bool claim_pending;
+
+    // What happened so far
+    uint32_t rollbacks, resimulated, stalls, desyncs;
+    uint32_t desync_tick;
+
+    // Binds local_port on every interface and sends to peer, "host:port"
+    bool open (int player, int local_port, const char* peer, int input_delay);
+    void setShim (double latency_ms, double jitter_ms, float loss_percent, uint64_t seed);
+    // Until both ends have heard from each other - false after timeout seconds
+    bool connect (uint64_t& seed, double timeout);
+    // game has just been through initGame(game, seed)
+    void start (Game& game);
+    // One tick of local inputs - false when the tick has to wait for the other side
+    bool advance (const Inputs& local);
+    uint32_t confirmedTick () const;    // the game is final up to here
+    bool confirmed () const;            // up to where it is now
+    // Until the other side has all our inputs, so it can confirm as far as we did
+    void finish (double timeout);
+    void close ();
+
+    void receive ();
+    void send ();
+    void flush ();
+    void simulate ();
+    void rollBack ();
+    void checkClaim ();
+    void ensure (uint32_t tick);
+};
+
+/* What a player controls of their inputs - player 1 only the green basket,
+   moved with either set of arrows */
+void ownInputs (int player, Inputs& inputs);
+/* The inputs step() gets from both players' */
+void mergeInputs (const Inputs& player0, const Inputs& player1, Inputs& merged);
+
+#endif
@@ -0,0 +1,1138 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "collide.h"
+#include "jobs.h"
+#include "sim.h"
+
+using namespace std;
+
+/*******
+ * Rng *
+ *******/
+
+void Rng::seed (uint64_t seed) {
+  this->state = 0;
+  this->inc = 1442695040888963407ULL;
+  this->next();
+  this->state += seed;
+  this->next();
+}
+
+uint32_t Rng::next () {
+  uint64_t old = this->state;
+  this->state = old*6364136223846793005ULL + this->inc;
+  uint32_t xorshifted = (uint32_t)(((old>>18)^old)>>27);
+  uint32_t rot = (uint32_t)(old>>59);
+  return (xorshifted>>rot) | (xorshifted<<((-rot)&31));
+}
+
+/* 24 bits, all a float holds */
+float Rng::uniform (float min, float max) {
+  return min + (float)(this->next()>>8) * (1.0f/16777216.0f) * (max-min);
+}
+
+int Rng::below (int n) {
+  return (int)(((uint64_t)this->next()*n)>>32);
+}
+
+/*********
+ * Laser *
+ *********/
+
+void Laser::moveUp() {
+  this->y+=0.07;
+  this->y_stick+=0.07;
+  this->y_shift+=0.07;
+  this->y_stick_shift+=0.07;
+}
+
+void Laser::moveDown() {
+  this->y+=-0.07;
+  this->y_stick+=-0.07;
+  this->y_shift+=-0.07;
+  this->y_stick_shift+=-0.07;
+}
+
+void Laser::stickMoveUp() {
+  if(this->rotate_angle<35.0) {
+    this->rotate_angle+=1.5;
+    this->x_bullet = this->stick_width*(1 - cos(this->rotate_angle*M_PI/180.0f));
+    this->y_bullet = this->stick_length*sin(this->rotate_angle*M_PI/180.0f);
+  }
+}
+
+void Laser::stickMoveDown() {
+  if(this->rotate_angle>-35.0) {
+    this->rotate_angle+=-1.5;
+    this->x_bullet = this->stick_width*(1 - cos(this->rotate_angle*M_PI/180.0f));
+    this->y_bullet = this->stick_length*sin(this->rotate_angle*M_PI/180.0f);
+  }
+}
+
+void Laser::create () {
+  float x_coord=0.3, y_coord=0.4, x_shift=-4, y_shift=0;
+
+  this->x = x_coord+x_shift;
+  this->y = y_coord+y_shift;
+  this->x_shift = x_shift;
+  this->y_shift = y_shift;
+
+  x_coord=0.3, y_coord=0.09, x_shift=-3.7, y_shift=0;
+
+  this->x_stick = x_coord+x_shift;
+  this->y_stick = y_coord+y_shift;
+  this->x_stick_shift = x_shift;
+  this->y_stick_shift = y_shift;
+  this->rotate_angle = 0;
+  this->stick_length = 2*y_coord;
+  this->stick_width = 2*x_coord;
+  this->x_bullet = 0;
+  this->y_bullet = 0;
+}
+
+/**********
+ * Basket *
+ **********/
+
+void Basket::moveLeft() {
+  this->x+=-0.4;
+  this->x_shift+=-0.4;
+}
+
+void Basket::moveRight() {
+  this->x+=0.4;
+  this->x_shift+=0.4;
+}
+
+void Basket::followCursor (float cursor_x) {
+  if(this->selected) {
+    this->x = cursor_x + (this->width)/2 + this->x_coord;
+    this->x_shift = cursor_x + (this->width)/2;
+  }
+}
+
+void Basket::create (Color color) {
+  float x_coord=0.6, y_coord=0.6, x_shift;
+
+  if(color == COLOR_RED)
+    x_shift=-1.0;
+  else
+    x_shift=1.0;
+
+  this->color = color;
+  this->x = x_coord+x_shift;
+  this->y = y_coord-3.4;
+  this->x_coord = x_coord;
+  this->y_coord = y_coord;
+  this->x_shift = x_shift;
+  this->y_shift = -3.4;
+  this->length = 2*y_coord;
+  this->width = 2*x_coord;
+  this->selected = 0;
+}
+
+/**********
+ * Mirror *
+ **********/
+
+void Mirror::create (float x_shift, float y_shift, float rotate_angle) {
+  float x_coord=0.6, y_coord=0.01;
+
+  this->x_shift = x_shift;
+  this->y_shift = y_shift;
+  this->length = 2*y_coord;
+  this->width = 2*x_coord;
+  this->rotate_angle = rotate_angle;
+  this->x = x_coord+x_shift-(this->width/2);
+  this->y = y_coord+y_shift;
+  this->y_center = y_shift;
+  this->prev_y_center = y_shift;
+  this->prev_rotate_angle = rotate_angle;
+  this->geometry_angle = NAN;
+  this->updateGeometry();
+}
+
+/* Redone only after the angle or position moved - most mirrors sit still
+   for the whole game, and the rest change once a tick at most */
+void Mirror::updateGeometry () {
+  if(this->rotate_angle==this->geometry_angle && this->x==this->geometry_x && this->y==this->geometry_y)
+    return;
+  float half_width = this->width/2;
+  this->ux = cos(this->rotate_angle*M_PI/180.0f);
+  this->uy = sin(this->rotate_angle*M_PI/180.0f);
+  this->nx = -this->uy;
+  this->ny = this->ux;
+  this->cx = this->x;
+  this->cy = this->y-this->length/2;
+  this->x0 = this->cx-half_width*this->ux;
+  this->y0 = this->cy-half_width*this->uy;
+  this->x1 = this->cx+half_width*this->ux;
+  this->y1 = this->cy+half_width*this->uy;
+  this->geometry_angle = this->rotate_angle;
+  this->geometry_x = this->x;
+  this->geometry_y = this->y;
+}
+
+/*********
+ * Pools *
+ *********/
+
+/* Next free slot of a pool, reusing vanished ones first - -1 when it has to grow */
+static int takeSlot (vector<int>& free_slots, int& count, int capacity) {
+  if(free_slots.size()!=0) {
+    int i = free_slots.back();
+    free_slots.pop_back();
+    return i;
+  }
+  if(count<capacity)
+    return count++;
+  return -1;
+}
+
+/* The first n slots of from over to, and to's slots from n up to old_count back
+   to blank - slots past count always hold what grow() put there */
+template <typename T>
+static void copySlots (vector<T>& to, const vector<T>& from, int n, int old_count, T blank) {
+  copy(from.begin(), from.begin()+n, to.begin());
+  if(old_count>n)
+    fill(to.begin()+n, to.begin()+old_count, blank);
+}
+
+/* Room for the pool to double, and never less than this */
+#define MIN_POOL_GROWTH 16
+
+void BulletPool::init (int capacity) {
+  this->count = 0;
+  this->x.clear();
+  this->y.clear();
+  this->prev_x.clear();
+  this->prev_y.clear();
+  this->vector_translate.clear();
+  this->rotate_angle.clear();
+  this->radius.clear();
+  this->x_laser_shift.clear();
+  this->y_laser_shift.clear();
+  this->reflected.clear();
+  this->free_slots.clear();
+  this->live.clear();
+  this->grow(capacity);
+}
+
+/* New slots start parked, like vanished ones */
+void BulletPool::grow (int capacity) {
+  this->x.resize(capacity, PARKED);
+  this->y.resize(capacity, PARKED);
+  this->prev_x.resize(capacity, PARKED);
+  this->prev_y.resize(capacity, PARKED);
+  this->vector_translate.resize(capacity, 0);
+  this->rotate_angle.resize(capacity, 0);
+  this->radius.resize(capacity, 0);
+  this->x_laser_shift.resize(capacity, 0);
+  this->y_laser_shift.resize(capacity, 0);
+  this->reflected.resize(capacity, 0);
+  this->live.resize(capacity);
+}
+
+int BulletPool::create (float rotate_angle) {
+  int i = takeSlot(this->free_slots, this->count, this->capacity());
+  if(i<0) {
+    this->grow(max(2*this->capacity(), MIN_POOL_GROWTH));
+    i = this->count++;
+  }
+  this->radius[i] = bullet_radius;
+  this->rotate_angle[i] = rotate_angle;
+  this->vector_translate[i] = 0;
+  this->reflected[i] = 0;
+  this->live.insert(i);
+  return i;
+}
+
+void BulletPool::vanish (int i) {
+  this->x[i] = this->prev_x[i] = PARKED;
+  this->y[i] = this->prev_y[i] = PARKED;
+  this->live.remove(i);
+  this->free_slots.push_back(i);
+}
+
+/* The state of from in slots this pool already has, so snapshots stop allocating
+   once they have seen the largest pool */
+void BulletPool::copyFrom (const BulletPool& from) {
+  int n = from.count, old_count = this->count;
+  if(this->capacity()<from.capacity())
+    this->grow(from.capacity());
+  copySlots(this->x, from.x, n, old_count, PARKED);
+  copySlots(this->y, from.y, n, old_count, PARKED);
+  copySlots(this->prev_x, from.prev_x, n, old_count, PARKED);
+  copySlots(this->prev_y, from.prev_y, n, old_count, PARKED);
+  copySlots(this->vector_translate, from.vector_translate, n, old_count, 0.0f);
+  copySlots(this->rotate_angle, from.rotate_angle, n, old_count, 0.0f);
+  copySlots(this->radius, from.radius, n, old_count, 0.0f);
+  copySlots(this->x_laser_shift, from.x_laser_shift, n, old_count, 0.0f);
+  copySlots(this->y_laser_shift, from.y_laser_shift, n, old_count, 0.0f);
+  copySlots(this->reflected, from.reflected, n, old_count, (unsigned char)0);
+  this->count = n;
+  this->free_slots = from.free_slots;
+  this->live.copyFrom(from.live);
+}
+
+void BrickPool::init (int capacity) {
+  this->count = 0;
+  this->x.clear();
+  this->y.clear();
+  this->prev_y.clear();
+  this->width.clear();
+  this->length.clear();
+  this->color.clear();
+  this->free_slots.clear();
+  this->live.clear();
+  for(int c=0;c<COLOR_COUNT;c++)
+    this->by_color[c].clear();
+  this->grow(capacity);
+}
+
+void BrickPool::grow (int capacity) {
+  this->x.resize(capacity, PARKED);
+  this->y.resize(capacity, PARKED);
+  this->prev_y.resize(capacity, PARKED);
+  this->width.resize(capacity, 0);
+  this->length.resize(capacity, 0);
+  this->color.resize(capacity, COLOR_BLACK);
+  this->live.resize(capacity);
+  for(int c=0;c<COLOR_COUNT;c++)
+    this->by_color[c].resize(capacity);
+}
+
+int BrickPool::create (float x_shift, Color color) {
+  float x_coord=0.08, y_coord=0.15, y_shift=3.5;
+
+  int i = takeSlot(this->free_slots, this->count, this->capacity());
+  if(i<0) {
+    this->grow(max(2*this->capacity(), MIN_POOL_GROWTH));
+    i = this->count++;
+  }
+  this->x[i] = x_coord+x_shift;
+  this->y[i] = y_coord+y_shift;
+  this->prev_y[i] = this->y[i];
+  this->length[i] = 2*y_coord;
+  this->width[i] = 2*x_coord;
+  this->color[i] = color;
+  this->live.insert(i);
+  this->by_color[color].insert(i);
+  return i;
+}
+
+void BrickPool::vanish (int i) {
+  this->by_color[this->color[i]].remove(i);
+  this->x[i] = PARKED;
+  this->y[i] = this->prev_y[i] = PARKED;
+  this->live.remove(i);
+  this->free_slots.push_back(i);
+}
+
+void BrickPool::copyFrom (const BrickPool& from) {
+  int n = from.count, old_count = this->count;
+  if(this->capacity()<from.capacity())
+    this->grow(from.capacity());
+  copySlots(this->x, from.x, n, old_count, PARKED);
+  copySlots(this->y, from.y, n, old_count, PARKED);
+  copySlots(this->prev_y, from.prev_y, n, old_count, PARKED);
+  copySlots(this->width, from.width, n, old_count, 0.0f);
+  copySlots(this->length, from.length, n, old_count, 0.0f);
+  copySlots(this->color, from.color, n, old_count, (unsigned char)COLOR_BLACK);
+  this->count = n;
+  this->free_slots = from.free_slots;
+  this->live.copyFrom(from.live);
+  for(int c=0;c<COLOR_COUNT;c++)
+    this->by_color[c].copyFrom(from.by_color[c]);
+}
+
+/*********
+ * Rules *
+ *********/
+
+void createBrick(Game& game) {
+  Color color = (Color)game.rng.below(3);
+  if(game.rng.below(2))
+    game.bricks.create(game.rng.uniform(0.8, 2.5), color);
+  else
+    game.bricks.create(game.rng.uniform(-2.3, -1.3), color);
+}
+
+void shootBullet(Game& game) {
+  game.bullets.create(game.laser.rotate_angle);
+}
+
+void checkBrickYLimit(Game& game) {
+  BrickPool& bricks = game.bricks;
+  int i, k;
+  for(k=bricks.live.size()-1;k>=0;k--) {
+    i = bricks.live.dense[k];
+    if(bricks.y[i]<game.baskets[0].y)
+      bricks.vanish(i);
+  }
+}
+
+/* Is brick i inside the basket's mouth */
+static bool inBasket(const BrickPool& bricks, int i, const Basket& basket) {
+  return bricks.y[i]>=basket.y && (bricks.y[i]-bricks.length[i])<=basket.y &&
+    (basket.x-basket.width)<=(bricks.x[i]-bricks.width[i]) && basket.x>=bricks.x[i];
+}
+
+struct BasketJobs {
+    Game* game;
+    int first;
+};
+
+/* Search 2b+0 finds basket b's own color in it and 2b+1 the black bricks, last
+   entry first - the order vanish() can take them in */
+static void findInBasket (Game& game, int search) {
+  const Basket& basket = game.baskets[search/2];
+  const vector<int>& list = game.bricks.by_color[(search%2) ? COLOR_BLACK : basket.color].dense;
+  vector<int>& found = game.basket_finds[search];
+  found.clear();
+  for(int k=(int)list.size()-1;k>=0;k--)
+    if(inBasket(game.bricks, list[k], basket))
+      found.push_back(list[k]);
+}
+
+static void findInBasketJob (void* data, int job) {
+  BasketJobs& jobs = *(BasketJobs*)data;
+  findInBasket(*jobs.game, 2*jobs.first+job);
+}
+
+/* A brick of its own color scores, a black one ends the game. The baskets
+   from first to last are searched together and settled in turn - vanishing
+   one basket's color never changes what another finds. */
+static void checkBaskets (Game& game, int first, int last) {
+  BrickPool& bricks = game.bricks;
+  int b, k, looked_at = bricks.by_color[COLOR_BLACK].size()*(last-first+1);
+  for(b=first;b<=last;b++)
+    looked_at += bricks.by_color[game.baskets[b].color].size();
+
+  if(looked_at>=BASKET_JOB_MIN_BRICKS) {
+    BasketJobs jobs = { &game, first };
+    runJobs(2*(last-first+1), findInBasketJob, &jobs);
+  }
+  for(b=first;b<=last;b++) {
+    if(looked_at<BASKET_JOB_MIN_BRICKS) {
+      findInBasket(game, 2*b);
+      findInBasket(game, 2*b+1);
+    }
+    vector<int>& caught = game.basket_finds[2*b];
+    for(k=0;k<(int)caught.size();k++) {
+      game.total_score+=3;
+      bricks.vanish(caught[k]);
+    }
+    if(game.basket_finds[2*b+1].size())
+      game.game_over=1;
+  }
+}
+
+void checkRedBasket(Game& game) {
+  checkBaskets(game, 0, 0);
+}
+
+void checkGreenBasket(Game& game) {
+  checkBaskets(game, 1, 1);
+}
+
+/*****************
+ * Swept contact *
+ *****************/
+
+void BulletPaths::clear () {
+  this->x.clear();
+  this->y.clear();
+  this->half_dx.clear();
+  this->half_dy.clear();
+  this->radius.clear();
+}
+
+void BulletPaths::append (const BulletPaths& more) {
+  this->x.insert(this->x.end(), more.x.begin(), more.x.end());
+  this->y.insert(this->y.end(), more.y.begin(), more.y.end());
+  this->half_dx.insert(this->half_dx.end(), more.half_dx.begin(), more.half_dx.end());
+  this->half_dy.insert(this->half_dy.end(), more.half_dy.begin(), more.half_dy.end());
+  this->radius.insert(this->radius.end(), more.radius.begin(), more.radius.end());
+}
+
+void BulletPaths::add (float x0, float y0, float x1, float y1, float radius) {
+  this->x.push_back((x0+x1)/2);
+  this->y.push_back((y0+y1)/2);
+  this->half_dx.push_back((x1-x0)/2);
+  this->half_dy.push_back((y1-y0)/2);
+  this->radius.push_back(radius);
+}
+
+float sweepCircleCapsule (float x, float y, float dx, float dy, float max_t,
+                          float cx, float cy, float ux, float uy, float half_width, float reach,
+                          float& nx, float& ny) {
+  float px = x-cx, py = y-cy;
+  float best = -1;
+
+  // Flat faces - distance from the segment's line, and how fast that closes
+  float s = px*(-uy) + py*ux, closing = dx*(-uy) + dy*ux;
+  if(s*closing < 0) {
+    float side = s > 0 ? 1 : -1;
+    float t = fabsf(s) <= reach ? 0 : (side*reach-s)/closing;
+    float along = (px+t*dx)*ux + (py+t*dy)*uy;
+    if(t <= max_t && fabsf(along) <= half_width) {
+      best = t;
+      nx = -side*uy;
+      ny = side*ux;
+    }
+  }
+
+  // Rounded ends, a ray against a circle at each end of the segment
+  for(int e=-1;e<=1;e+=2) {
+    float ex = px-e*half_width*ux, ey = py-e*half_width*uy;
+    float b = ex*dx + ey*dy;
+    if(b >= 0)
+      continue;
+    float c = ex*ex + ey*ey - reach*reach, t;
+    if(c <= 0)
+      t = 0;
+    else {
+      float disc = b*b - c;
+      if(disc < 0)
+        continue;
+      t = -b - sqrtf(disc);
+    }
+    if(t <= max_t && (best < 0 || t < best)) {
+      best = t;
+      float hx = ex+t*dx, hy = ey+t*dy, len = sqrtf(hx*hx + hy*hy);
+      nx = len > 0 ? hx/len : -dx;
+      ny = len > 0 ? hy/len : -dy;
+    }
+  }
+  return best;
+}
+
+bool sweptCircleHitsBox (float x0, float y0, float x1, float y1, float r,
+                         float cx, float cy, float hw, float hh) {
+  float mx = (x0+x1)/2-cx, my = (y0+y1)/2-cy;
+  float hx = (x1-x0)/2, hy = (y1-y0)/2;
+  float ex = hw+r, ey = hh+r;
+  return fabsf(mx) <= ex+fabsf(hx) && fabsf(my) <= ey+fabsf(hy) &&
+         fabsf(mx*hy - my*hx) <= ex*fabsf(hy) + ey*fabsf(hx);
+}
+
+/* What each moveBullets job needs - job j takes live.dense from j*BULLET_JOB_SIZE */
+struct BulletJobs {
+    Game* game;
+    float k;
+    float x_muzzle, y_muzzle;
+    float cx[MAX_MIRRORS], cy[MAX_MIRRORS], ux[MAX_MIRRORS], uy[MAX_MIRRORS];
+    float half_width[MAX_MIRRORS], thickness[MAX_MIRRORS];
+};
+
+/* Where each bullet ends up if nothing is in the way, from where it was */
+static void aimBullets (void* data, int job) {
+  BulletJobs& jobs = *(BulletJobs*)data;
+  BulletPool& bullets = jobs.game->bullets;
+  int i, d, end = min(bullets.live.size(), (job+1)*BULLET_JOB_SIZE);
+
+  for(d=job*BULLET_JOB_SIZE;d<end;d++) {
+    i = bullets.live.dense[d];
+    bool fired = (bullets.vector_translate[i]==0);
+    if(!bullets.reflected[i]) {
+      bullets.x_laser_shift[i] = jobs.x_muzzle;
+      bullets.y_laser_shift[i] = jobs.y_muzzle;
+    }
+    float x = bullets.x_laser_shift[i]+bullets.vector_translate[i]*cos(bullets.rotate_angle[i]*M_PI/180.0f);
+    float y = bullets.y_laser_shift[i]+bullets.vector_translate[i]*sin(bullets.rotate_angle[i]*M_PI/180.0f);
+    // A bullet fired this step has no previous position to blend from
+    bullets.prev_x[i] = fired ? x : bullets.x[i];
+    bullets.prev_y[i] = fired ? y : bullets.y[i];
+    bullets.x[i] = x;
+    bullets.y[i] = y;
+  }
+}
+
+/* Most bullets are nowhere near a mirror - only the rest get the exact sweep.
+   By slot rather than live order, BULLET_JOB_SIZE slots a job. */
+static void findBulletsNearMirrors (void* data, int job) {
+  BulletJobs& jobs = *(BulletJobs*)data;
+  Game& game = *jobs.game;
+  BulletPool& bullets = game.bullets;
+  int first = job*BULLET_JOB_SIZE, n = min(bullets.count-first, BULLET_JOB_SIZE);
+  legsNearMirrors(&bullets.prev_x[first], &bullets.prev_y[first], &bullets.x[first], &bullets.y[first],
+                  &bullets.radius[first], n, jobs.cx, jobs.cy, jobs.ux, jobs.uy, jobs.half_width,
+                  jobs.thickness, game.total_mirrors, &game.mirror_near[first]);
+}
+
+/* The sweep, and each bullet's legs into its job's paths */
+static void reflectBullets (void* data, int job) {
+  BulletJobs& jobs = *(BulletJobs*)data;
+  Game& game = *jobs.game;
+  BulletPool& bullets = game.bullets;
+  BulletPaths& paths = job ? game.bullet_path_jobs[job] : game.bullet_paths;
+  const float *cx = jobs.cx, *cy = jobs.cy, *ux = jobs.ux, *uy = jobs.uy;
+  const float *half_width = jobs.half_width, *thickness = jobs.thickness;
+  int i, d, m, bounce, end = min(bullets.live.size(), (job+1)*BULLET_JOB_SIZE);
+  float k = jobs.k;
+
+  paths.clear();
+  for(d=job*BULLET_JOB_SIZE;d<end;d++) {
+    i = bullets.live.dense[d];
+    float x0 = bullets.prev_x[i], y0 = bullets.prev_y[i];
+    if(!game.mirror_near[i]) {
+      paths.add(x0, y0, bullets.x[i], bullets.y[i], bullets.radius[i]);
+      bullets.vector_translate[i]+=game.bullet_speed*k;
+      continue;
+    }
+
+    float dx = bullets.x[i]-x0, dy = bullets.y[i]-y0, left = sqrtf(dx*dx + dy*dy);
+    if(left > 0) {
+      dx /= left;
+      dy /= left;
+    }
+    bool bounced = false;
+    for(bounce=0;bounce<MAX_BOUNCES && left>0;bounce++) {
+      float t_hit = -1, nx = 0, ny = 0, hx, hy;
+      for(m=0;m<game.total_mirrors;m++) {
+        float t = sweepCircleCapsule(x0, y0, dx, dy, left, cx[m], cy[m], ux[m], uy[m],
+                                     half_width[m], bullets.radius[i]+thickness[m], hx, hy);
+        if(t >= 0 && (t_hit < 0 || t < t_hit)) {
+          t_hit = t;
+          nx = hx;
+          ny = hy;
+        }
+      }
+      if(t_hit < 0)
+        break;
+      paths.add(x0, y0, x0+t_hit*dx, y0+t_hit*dy, bullets.radius[i]);
+      x0 += t_hit*dx;
+      y0 += t_hit*dy;
+      left -= t_hit;
+      float d = dx*nx + dy*ny;
+      dx -= 2*d*nx;
+      dy -= 2*d*ny;
+      bullets.rotate_angle[i] = atan2(dy, dx)*180.0f/M_PI;
+      bullets.reflected[i] = 1;
+      bullets.x_laser_shift[i] = x0;
+      bullets.y_laser_shift[i] = y0;
+      bounced = true;
+    }
+    if(bounced) {
+      bullets.x[i] = x0+left*dx;
+      bullets.y[i] = y0+left*dy;
+      bullets.vector_translate[i] = left;
+    }
+    paths.add(x0, y0, bullets.x[i], bullets.y[i], bullets.radius[i]);
+    bullets.vector_translate[i]+=game.bullet_speed*k;
+  }
+}
+
+/* Bullets travel, following the laser until their first reflection. Each one is
+   swept along this tick's travel against the mirrors where they now stand - on
+   contact it turns at the contact point and carries on with what is left of the
+   distance, up to MAX_BOUNCES times. The legs go to game.bullet_paths, in live
+   order however many jobs moved them. */
+void moveBullets (Game& game, float k) {
+  BulletPool& bullets = game.bullets;
+  Laser& laser = game.laser;
+  BulletJobs jobs;
+  int m, j;
+
+  jobs.game = &game;
+  jobs.k = k;
+  for(m=0;m<game.total_mirrors;m++) {
+    Mirror& mirror = game.mirrors[m];
+    mirror.updateGeometry();
+    jobs.ux[m] = mirror.ux;
+    jobs.uy[m] = mirror.uy;
+    jobs.cx[m] = mirror.cx;
+    jobs.cy[m] = mirror.cy;
+    jobs.half_width[m] = mirror.width/2;
+    jobs.thickness[m] = mirror.length/2;
+  }
+  jobs.x_muzzle = laser.x_stick+laser.x_bullet;
+  jobs.y_muzzle = laser.y_stick-(laser.stick_length/2)+laser.y_bullet;
+
+  // Each pass needs the last one done for every bullet
+  int live_jobs = (bullets.live.size()+BULLET_JOB_SIZE-1)/BULLET_JOB_SIZE;
+  int slot_jobs = (bullets.count+BULLET_JOB_SIZE-1)/BULLET_JOB_SIZE;
+  game.mirror_near.resize(bullets.capacity());
+  if((int)game.bullet_path_jobs.size()<live_jobs)
+    game.bullet_path_jobs.resize(live_jobs);
+  runJobs(live_jobs, aimBullets, &jobs);
+  runJobs(slot_jobs, findBulletsNearMirrors, &jobs);
+  runJobs(live_jobs, reflectBullets, &jobs);
+
+  if(!live_jobs)
+    game.bullet_paths.clear();
+  for(j=1;j<live_jobs;j++)
+    game.bullet_paths.append(game.bullet_path_jobs[j]);
+}
+
+void findBrickHits (const BrickPool& bricks, const BulletPaths& paths, vector<int>& hits) {
+  const float *x = &paths.x[0], *y = &paths.y[0], *radius = &paths.radius[0];
+  const float *half_dx = &paths.half_dx[0], *half_dy = &paths.half_dy[0];
+  int i, j, k, hit, n = paths.size();
+  float y_brick_center, x_brick_center, half_width, half_length;
+  hits.clear();
+  if(!n)
+    return;
+  for(k=0;k<bricks.live.size();k++) {
+    i = bricks.live.dense[k];
+    half_width = bricks.width[i]/2;
+    half_length = bricks.length[i]/2;
+    y_brick_center = bricks.y[i] - half_length;
+    x_brick_center = bricks.x[i] - half_width;
+    // sweptCircleHitsBox inlined, with no early exit so this vectorizes
+    hit = 0;
+    for(j=0;j<n;j++) {
+      float mx = x[j]-x_brick_center, my = y[j]-y_brick_center;
+      float ex = half_width+radius[j], ey = half_length+radius[j];
+      float hx = fabsf(half_dx[j]), hy = fabsf(half_dy[j]);
+      hit |= (fabsf(mx)<=ex+hx) & (fabsf(my)<=ey+hy) &
+             (fabsf(mx*half_dy[j]-my*half_dx[j])<=ex*hy+ey*hx);
+    }
+    if(hit)
+      hits.push_back(i);
+  }
+}
+
+void BrickGrid::init (float x_min, float y_min, float x_max, float y_max, float cell_size) {
+  this->x_min = x_min;
+  this->y_min = y_min;
+  this->cell_size = cell_size;
+  this->columns = (int)ceil((x_max-x_min)/cell_size);
+  this->rows = (int)ceil((y_max-y_min)/cell_size);
+  this->cell_start.assign(this->columns*this->rows+1, 0);
+  this->items.clear();
+}
+
+/* Clamped in float first - a bullet far off screen must not overflow the int */
+int BrickGrid::column (float x) const {
+  float c = (x-this->x_min)/this->cell_size;
+  if(c < 0)
+    return 0;
+  if(c >= this->columns)
+    return this->columns-1;
+  return (int)c;
+}
+
+int BrickGrid::row (float y) const {
+  float r = (y-this->y_min)/this->cell_size;
+  if(r < 0)
+    return 0;
+  if(r >= this->rows)
+    return this->rows-1;
+  return (int)r;
+}
+
+void BrickGrid::build (const BrickPool& bricks) {
+  int i, k, d, c, cells = this->columns*this->rows;
+  vector<int>& start = this->cell_start;
+
+  this->reach_x = this->reach_y = 0;
+  this->brick_cell.resize(bricks.capacity());
+  this->hit.resize(bricks.capacity());
+  start.assign(cells+1, 0);
+
+  // Count bricks per cell, shifted by one so the prefix sum gives start offsets
+  for(d=0;d<bricks.live.size();d++) {
+    i = bricks.live.dense[d];
+    float half_width = bricks.width[i]/2, half_length = bricks.length[i]/2;
+    c = this->row(bricks.y[i]-half_length)*this->columns + this->column(bricks.x[i]-half_width);
+    this->brick_cell[i] = c;
+    start[c+1]++;
+    this->reach_x = max(this->reach_x, half_width);
+    this->reach_y = max(this->reach_y, half_length);
+  }
+  for(c=0;c<cells;c++)
+    start[c+1] += start[c];
+
+  // Fill each cell from its end, which walks start[c+1] back to the first item of cell c
+  int n = start[cells];
+  this->items.resize(n);
+  this->item_x.resize(n);
+  this->item_y.resize(n);
+  this->item_half_width.resize(n);
+  this->item_half_length.resize(n);
+  this->item_hit.assign(n, 0);
+  for(d=0;d<bricks.live.size();d++) {
+    i = bricks.live.dense[d];
+    k = --start[this->brick_cell[i]+1];
+    this->items[k] = i;
+    this->item_half_width[k] = bricks.width[i]/2;
+    this->item_half_length[k] = bricks.length[i]/2;
+    this->item_x[k] = bricks.x[i]-this->item_half_width[k];
+    this->item_y[k] = bricks.y[i]-this->item_half_length[k];
+  }
+  for(c=0;c<cells;c++)
+    start[c] = start[c+1];
+  start[cells] = n;
+}
+
+/* The grid query split into bands of rows - a band's bricks are a run of items
+   no other band touches, so the jobs never write to the same hit byte */
+struct GridJobs {
+    BrickGrid* grid;
+    const BulletPaths* paths;
+    int bands;
+};
+
+static void queryGridBand (void* data, int band) {
+  GridJobs& jobs = *(GridJobs*)data;
+  BrickGrid& grid = *jobs.grid;
+  const BulletPaths& paths = *jobs.paths;
+  int j, k, r, band_r0 = band*grid.rows/jobs.bands, band_r1 = (band+1)*grid.rows/jobs.bands-1;
+
+  const float *item_x = &grid.item_x[0], *item_y = &grid.item_y[0];
+  const float *half_width = &grid.item_half_width[0], *half_length = &grid.item_half_length[0];
+  unsigned char *item_hit = &grid.item_hit[0];
+  for(j=0;j<paths.size();j++) {
+    float x = paths.x[j], y = paths.y[j], radius = paths.radius[j];
+    float dx = paths.half_dx[j], dy = paths.half_dy[j], hx = fabsf(dx), hy = fabsf(dy);
+    int r0 = max(band_r0, grid.row(y-hy-grid.reach_y-radius)), r1 = min(band_r1, grid.row(y+hy+grid.reach_y+radius));
+    if(r0>r1)
+      continue;
+    int c0 = grid.column(x-hx-grid.reach_x-radius), c1 = grid.column(x+hx+grid.reach_x+radius);
+    // Neighbouring cells of a row sit next to each other in items - one run per row
+    for(r=r0;r<=r1;r++) {
+      int end = grid.cell_start[r*grid.columns+c1+1];
+      k = grid.cell_start[r*grid.columns+c0];
+      legHitsBoxes(x, y, dx, dy, radius, item_x+k, item_y+k, half_width+k, half_length+k, end-k, item_hit+k);
+    }
+  }
+}
+
+void findBrickHitsGrid (BrickGrid& grid, const BrickPool& bricks, const BulletPaths& paths, vector<int>& hits) {
+  int k;
+  hits.clear();
+  grid.build(bricks);
+  if(!grid.items.size())
+    return;
+
+  GridJobs jobs = { &grid, &paths, 1 };
+  if(jobThreads()>1 && (long)grid.items.size()*paths.size()>=GRID_JOB_MIN_PAIRS)
+    jobs.bands = min(grid.rows, 4*jobThreads());
+  runJobs(jobs.bands, queryGridBand, &jobs);
+
+  unsigned char *item_hit = &grid.item_hit[0];
+  // Collected in live order like the brute force scan, so which one ran never changes the game
+  for(k=0;k<(int)grid.items.size();k++)
+    grid.hit[grid.items[k]] = item_hit[k];
+  for(k=0;k<bricks.live.size();k++)
+    if(grid.hit[bricks.live.dense[k]])
+      hits.push_back(bricks.live.dense[k]);
+}
+
+/* Bullets past the edge of the world, last live entry first - the order vanish() can take them in */
+static void findBulletsOut (void* data, int /*job*/) {
+  Game& game = *(Game*)data;
+  BulletPool& bullets = game.bullets;
+  int i, k;
+  game.bullets_out.clear();
+  for(k=bullets.live.size()-1;k>=0;k--) {
+    i = bullets.live.dense[k];
+    if(fabs(bullets.x[i])>25||fabs(bullets.y[i])>25)
+      game.bullets_out.push_back(i);
+  }
+}
+
+static void removeBulletsOut (Game& game) {
+  for(int k=0;k<(int)game.bullets_out.size();k++)
+    game.bullets.vanish(game.bullets_out[k]);
+}
+
+/* The hit search only reads the bullets' legs, so step() looks for bullets
+   out of the window alongside it - bricks and bullets are settled after */
+static void collideBricks (Game& game, bool cull_bullets) {
+  BrickPool& bricks = game.bricks;
+  vector<int>& hits = game.brick_hits;
+  long pairs = (long)bricks.alive()*game.bullet_paths.size();
+  JobBatch cull;
+  if(cull_bullets) {
+    if(pairs>=GRID_JOB_MIN_PAIRS)
+      submitJob(cull, findBulletsOut, &game, 0);
+    else
+      findBulletsOut(&game, 0);
+  }
+  if(pairs < BROADPHASE_MIN_PAIRS)
+    findBrickHits(bricks, game.bullet_paths, hits);
+  else
+    findBrickHitsGrid(game.brick_grid, bricks, game.bullet_paths, hits);
+  waitJobs(cull);
+
+  for(int k=0;k<(int)hits.size();k++) {
+    if(bricks.color[hits[k]]==COLOR_BLACK)
+      game.total_score+=2;
+    bricks.vanish(hits[k]);
+  }
+  if(cull_bullets)
+    removeBulletsOut(game);
+}
+
+void checkBrickBulletCollision (Game& game) {
+  collideBricks(game, false);
+}
+
+void checkBulletOutOfWindow (Game& game) {
+  findBulletsOut(&game, 0);
+  removeBulletsOut(game);
+}
+
+static void setRandomizedMirror (Game& game) {
+  if((game.ticks-game.last_mirror_tick) >= MIRROR_MOVE_TICKS && game.level3) {
+    int col=game.rng.below(2);
+    float x_coord, y_coord, angle;
+    if(col)
+      x_coord=game.rng.uniform(-2.3, -1.3);
+    else
+      x_coord=game.rng.uniform(0.8, 2.5);
+    // One draw per statement, so the order is fixed whatever the compiler does with arguments
+    y_coord=game.rng.uniform(-1.6, 2.2);
+    angle=game.rng.uniform(-360, 360);
+    game.mirrors[4].create(x_coord, y_coord, angle);
+    game.last_mirror_tick=game.ticks;
+  }
+}
+
+void checkLevel(Game& game) {
+  if(game.total_score>=3 && game.total_score<=6)
+    game.level2=1;
+  else if(game.total_score>6){
+    game.level3=1;
+    game.total_mirrors=5;
+  }
+}
+
+static void updateMouseLaserAngle (Game& game, float X, float Y) {
+  Laser& laser = game.laser;
+  laser.rotate_angle = atan((laser.y_stick_shift - Y)/(laser.x_stick_shift - X))*180.0f/M_PI;
+}
+
+/* Right click - drop the basket being carried, or pick up the one under the cursor */
+static void selectBasket (Game& game, float X, float Y) {
+  Basket* baskets = game.baskets;
+  if(baskets[0].selected || baskets[1].selected) {
+    if(baskets[0].selected)
+      baskets[0].selected = 0;
+    else if(baskets[1].selected)
+      baskets[1].selected = 0;
+  }
+  else {
+    if(X<baskets[0].x&&X>(baskets[0].x-baskets[0].width)&&
+      Y<baskets[0].y&&Y>(baskets[0].y-baskets[0].length)) {
+      baskets[0].selected = 1;
+    }
+    else if(X<baskets[1].x&&X>(baskets[1].x-baskets[1].width)&&
+      Y<baskets[1].y&&Y>(baskets[1].y-baskets[1].length)) {
+      baskets[1].selected = 1;
+    }
+  }
+}
+
+/********
+ * Step *
+ ********/
+
+void initGame (Game& game, uint64_t seed) {
+  game.seed=seed;
+  game.rng.seed(seed);
+  game.bricks.init(MAX_BRICKS);
+  game.bullets.init(MAX_BULLETS);
+  game.brick_grid.init(-4, -4, 4, 4, 0.5);
+  game.total_score=0;
+  game.total_time=60;
+  game.game_over=0;
+  game.total_mirrors=4;
+  game.bricks_speed=0.005;
+  game.bullet_speed=0.04;
+  game.mirror_rotate_speed=1;
+  game.mirror_trans_speed_1=0;
+  game.mirror_trans_speed_2=0;
+  game.mirror_up_1=0;
+  game.mirror_up_2=0;
+  game.level1=1;
+  game.level2=0;
+  game.level3=0;
+  game.laser.create();
+  game.baskets[0].create(COLOR_RED);
+  game.baskets[1].create(COLOR_GREEN);
+  game.mirrors[0].create(0.2, 2.9, -30);
+  game.mirrors[1].create(0.2, -1.7, 25);
+  game.mirrors[2].create(3.2, 2.3, -45);
+  game.mirrors[3].create(3.6, -1.6, 60);
+  game.ticks=0;
+  game.last_brick_tick=0;
+  game.last_bullet_tick=0;
+  game.last_clock_tick=0;
+  game.last_mirror_tick=0;
+}
+
+void clearInputs (Inputs& inputs) {
+  inputs.shoot=0;
+  inputs.select_basket=0;
+  inputs.laser_move=0;
+  inputs.stick_move=0;
+  inputs.basket_move[0]=0;
+  inputs.basket_move[1]=0;
+  inputs.speed_change=0;
+}
+
+static void applyInputs (Game& game, const Inputs& inputs) {
+  int i, n;
+
+  for(n=inputs.laser_move;n>0;n--)
+    game.laser.moveUp();
+  for(n=inputs.laser_move;n<0;n++)
+    game.laser.moveDown();
+  for(n=inputs.stick_move;n>0;n--)
+    game.laser.stickMoveUp();
+  for(n=inputs.stick_move;n<0;n++)
+    game.laser.stickMoveDown();
+  for(i=0;i<2;i++) {
+    for(n=inputs.basket_move[i];n>0;n--)
+      game.baskets[i].moveRight();
+    for(n=inputs.basket_move[i];n<0;n++)
+      game.baskets[i].moveLeft();
+  }
+  for(n=inputs.speed_change;n>0;n--)
+    if(game.bricks_speed<=0.02)
+      game.bricks_speed+=0.001;
+  for(n=inputs.speed_change;n<0;n++)
+    if(game.bricks_speed>=0.003)
+      game.bricks_speed+=-0.001;
+
+  if(inputs.select_basket)
+    selectBasket(game, inputs.cursor_x, inputs.cursor_y);
+
+  if(inputs.shoot && (game.ticks - game.last_bullet_tick) >= SHOT_COOLDOWN_TICKS) {
+    game.last_bullet_tick = game.ticks;
+    shootBullet(game);
+  }
+}
+
+static void moveEntities (Game& game, float k) {
+  int i;
+
+  // Bricks fall - dead slots move too, which keeps the loop branch free
+  BrickPool& bricks = game.bricks;
+  float fall = game.bricks_speed*k;
+  for(i=0;i<bricks.count;i++) {
+    bricks.prev_y[i] = bricks.y[i];
+    bricks.y[i] -= fall;
+  }
+
+  // Mirrors rotate and slide
+  for(i=0;i<game.total_mirrors;i++) {
+    Mirror& mirror = game.mirrors[i];
+    mirror.prev_y_center = mirror.y_center;
+    mirror.prev_rotate_angle = mirror.rotate_angle;
+    if(i==0){
+      if(game.level1)
+        mirror.rotate_angle+=game.mirror_rotate_speed*k;
+      if(game.level2) {
+        mirror.rotate_angle+=(game.mirror_rotate_speed+3)*k;
+        mirror.y-=game.mirror_trans_speed_1;
+        if((mirror.y_shift+game.mirror_trans_speed_1)<0.0)
+          game.mirror_up_1=1;
+        if((mirror.y_shift+game.mirror_trans_speed_1)>2.9)
+          game.mirror_up_1=0;
+        if(!game.mirror_up_1)
+          game.mirror_trans_speed_1-=0.007*k;
+        else
+          game.mirror_trans_speed_1+=0.007*k;
+        mirror.y_center = mirror.y_shift+game.mirror_trans_speed_1;
+        mirror.y+=game.mirror_trans_speed_1;
+      }
+    }
+    else if(i==1) {
+      if(game.level2) {
+        // Snap back to level rather than sweeping through 150 degrees in one frame
+        if(mirror.rotate_angle<-150) {
+          mirror.rotate_angle=0;
+          mirror.prev_rotate_angle=0;
+          game.mirror_up_2=1;
+        }
+        if(mirror.rotate_angle>150) {
+          mirror.rotate_angle=0;
+          mirror.prev_rotate_angle=0;
+          game.mirror_up_2=0;
+        }
+        if(!game.mirror_up_2)
+          mirror.rotate_angle-=(game.mirror_rotate_speed+0.7)*k;
+        else
+          mirror.rotate_angle+=(game.mirror_rotate_speed+0.7)*k;
+      }
+    }
+  }
+}
+
+void step (Game& game, float dt, const Inputs& inputs) {
+  if(game.game_over)
+    return;
+
+  game.ticks++;
+  applyInputs(game, inputs);
+  moveEntities(game, dt/SIM_TICK);
+  moveBullets(game, dt/SIM_TICK);
+
+  checkBaskets(game, 0, 1);
+  game.baskets[0].followCursor(inputs.cursor_x);
+  game.baskets[1].followCursor(inputs.cursor_x);
+  collideBricks(game, true);
+  checkBrickYLimit(game);
+  checkLevel(game);
+  updateMouseLaserAngle(game, inputs.cursor_x, inputs.cursor_y);
+  setRandomizedMirror(game);
+
+  if((game.ticks - game.last_brick_tick) >= BRICK_SPAWN_TICKS) {
+    createBrick(game);
+    game.last_brick_tick = game.ticks;
+  }
+
+  if((game.ticks - game.last_clock_tick) >= CLOCK_TICKS) {
+    if(game.total_time==0)
+      game.game_over=1;
+    else
+      game.total_time--;
+    game.last_clock_tick = game.ticks;
+  }
+}
+
+/* FNV-1a */
+static uint64_t hashBytes (uint64_t h, const void* data, size_t size) {
+  const unsigned char* p = (const unsigned char*)data;
+  for(size_t i=0;i<size;i++)
+    h = (h^p[i])*1099511628211ULL;
+  return h;
+}
+
+uint64_t hashGame (const Game& game) {
+  uint64_t h = 14695981039346656037ULL;
+  int i, k;
+  h = hashBytes(h, &game.ticks, sizeof(game.ticks));
+  h = hashBytes(h, &game.total_score, sizeof(game.total_score));
+  h = hashBytes(h, &game.total_time, sizeof(game.total_time));
+  h = hashBytes(h, &game.game_over, sizeof(game.game_over));
+  h = hashBytes(h, &game.rng.state, sizeof(game.rng.state));
+  h = hashBytes(h, &game.laser.y_shift, sizeof(float));
+  h = hashBytes(h, &game.laser.rotate_angle, sizeof(float));
+  for(i=0;i<2;i++)
+    h = hashBytes(h, &game.baskets[i].x_shift, sizeof(float));
+  // Only the mirrors in play, the last is not set up before level 3
+  for(i=0;i<game.total_mirrors;i++) {
+    h = hashBytes(h, &game.mirrors[i].y_center, sizeof(float));
+    h = hashBytes(h, &game.mirrors[i].rotate_angle, sizeof(float));
+  }
+  for(k=0;k<game.bricks.live.size();k++) {
+    i = game.bricks.live.dense[k];
+    h = hashBytes(h, &game.bricks.x[i], sizeof(float));
+    h = hashBytes(h, &game.bricks.y[i], sizeof(float));
+    h = hashBytes(h, &game.bricks.color[i], 1);
+  }
+  for(k=0;k<game.bullets.live.size();k++) {
+    i = game.bullets.live.dense[k];
+    h = hashBytes(h, &game.bullets.x[i], sizeof(float));
+    h = hashBytes(h, &game.bullets.y[i], sizeof(float));
+  }
+  return h;
+}
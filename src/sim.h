@@ -0,0 +1,342 @@
+#ifndef CRAZYBRICKS_SIM_H
+#define CRAZYBRICKS_SIM_H
+
+/* Game state and rules with no GL or window dependency - the GL frontend in
+   Sample_GL3_2D.cpp draws a Game, batch tools and CI can step one headless */
+
+#include <stdint.h>
+#include <vector>
+
+/* Starting pool sizes, pools grow past them when full */
+#define MAX_BRICKS 100
+#define MAX_BULLETS 100
+#define MAX_MIRRORS 5
+
+/* Speeds are in world units per SIM_TICK, step() scales them by dt */
+const double SIM_TICK = 1.0/60;
+
+/* Timers count calls to step(), so they fire on the same tick every run */
+#define SHOT_COOLDOWN_TICKS 60      // one shot a second
+#define BRICK_SPAWN_TICKS 90        // a brick every 1.5 s
+#define MIRROR_MOVE_TICKS 90        // level 3 moves mirror 4 every 1.5 s
+#define CLOCK_TICKS 60              // total_time counts down in seconds
+
+const float bullet_radius = 0.09;
+
+/* Mirror bounces a bullet may take within one tick */
+#define MAX_BOUNCES 4
+
+/* Positions are in world coordinates - the view is -4..4 on both axes */
+
+enum Color {
+    COLOR_RED,
+    COLOR_GREEN,
+    COLOR_BLACK,
+    COLOR_COUNT
+};
+
+/* Sparse set of pool slots - O(1) insert and remove, and loops walk only the
+   slots in it:
+     for(k=0;k<live.size();k++) { i = live.dense[k]; ... }
+   dense is unordered, remove() moves the last entry into the hole - loop
+   backwards when removing as you go. */
+struct SlotSet {
+    std::vector<int> dense;             // slots in the set
+    std::vector<int> index;             // position of each slot in dense, -1 when not in it
+
+    void clear () { dense.clear(); index.clear(); }
+    void resize (int slots) { index.resize(slots, -1); }
+    int size () const { return (int)dense.size(); }
+    bool test (int i) const { return index[i] >= 0; }
+    void insert (int i) { index[i] = size(); dense.push_back(i); }
+    void remove (int i) {
+        int last = dense.back();
+        dense[index[i]] = last;
+        index[last] = index[i];
+        dense.pop_back();
+        index[i] = -1;
+    }
+    // Same members as from, touching only the slots in either - index has to cover from's
+    void copyFrom (const SlotSet& from) {
+        int k;
+        for(k=0;k<size();k++)
+            index[dense[k]] = -1;
+        dense = from.dense;
+        for(k=0;k<size();k++)
+            index[dense[k]] = k;
+    }
+};
+
+class Laser {
+   public:
+      float x;
+      float y;
+      float x_stick;
+      float y_stick;
+      float stick_width;
+      float stick_length;
+      float x_bullet;
+      float y_bullet;
+      float x_shift;
+      float y_shift;
+      float x_stick_shift;
+      float y_stick_shift;
+      float rotate_angle;
+
+      void moveUp ();
+      void moveDown ();
+      void stickMoveUp ();
+      void stickMoveDown ();
+      void create ();
+};
+
+class Basket {
+   public:
+      float x;            // right edge
+      float y;            // top edge
+      float x_shift;      // centre
+      float y_shift;
+      float x_coord;      // half extents
+      float y_coord;
+      float width;
+      float length;
+      bool selected;
+      Color color;
+
+      void moveLeft ();
+      void moveRight ();
+      void followCursor (float cursor_x);
+      void create (Color color);
+};
+
+class Mirror {
+   public:
+      float x;            // centre of the top face, moveBullets sweeps bullets against the
+      float y;            // segment half a thickness below it
+      float x_shift;
+      float y_shift;
+      float width;
+      float length;
+      float rotate_angle;
+      float y_center;     // where it is drawn, level 2 slides mirror 0 up and down
+      float prev_y_center;
+      float prev_rotate_angle;
+
+      // What bullets bounce off, the centre line of the mirror - kept by updateGeometry()
+      float ux, uy;           // unit vector along it
+      float nx, ny;           // unit normal, a quarter turn anticlockwise from (ux,uy)
+      float cx, cy;           // middle
+      float x0, y0, x1, y1;   // ends
+      float geometry_angle, geometry_x, geometry_y;  // what it was worked out from
+
+      void create (float x_shift, float y_shift, float rotate_angle);
+      void updateGeometry ();
+};
+
+/* Entities that come and go by the hundred are kept as parallel arrays, so the
+   per-tick loops read only the fields they use. Slots freed by vanish() are
+   handed out again by create() before count grows, and a full pool doubles.
+   A slot keeps its number while it lives, live lists the live ones. Slots
+   past count are always as grow() left them, so copyFrom() moves only the
+   first count and a snapshot costs what is in use, not the capacity. */
+
+/* Where vanish() leaves a dead slot - far outside every collision test, so inner
+   loops can scan all count slots without checking liveness */
+const float PARKED = 1e30f;
+
+struct BulletPool {
+    int count;                          // slots handed out so far, live or not
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> prev_x;
+    std::vector<float> prev_y;
+    std::vector<float> vector_translate;  // distance travelled from (x_laser_shift, y_laser_shift)
+    std::vector<float> rotate_angle;
+    std::vector<float> radius;
+    std::vector<float> x_laser_shift;
+    std::vector<float> y_laser_shift;
+    std::vector<unsigned char> reflected;
+    std::vector<int> free_slots;
+    SlotSet live;
+
+    void init (int capacity);
+    void grow (int capacity);
+    int capacity () const { return (int)x.size(); }
+    int alive () const { return live.size(); }
+    int create (float rotate_angle);    // slot
+    void vanish (int i);
+    void copyFrom (const BulletPool& from);
+};
+
+struct BrickPool {
+    int count;
+    std::vector<float> x;               // right edge
+    std::vector<float> y;               // top edge
+    std::vector<float> prev_y;
+    std::vector<float> width;
+    std::vector<float> length;
+    std::vector<unsigned char> color;   // Color
+    std::vector<int> free_slots;
+    SlotSet live;
+    SlotSet by_color[COLOR_COUNT];      // so a basket only visits the colors it cares about
+
+    void init (int capacity);
+    void grow (int capacity);
+    int capacity () const { return (int)x.size(); }
+    int alive () const { return live.size(); }
+    int create (float x_shift, Color color);
+    void vanish (int i);
+    void copyFrom (const BrickPool& from);
+};
+
+/* The straight legs each live bullet travelled this tick, split at mirror bounces.
+   Bricks are tested against the whole leg, so a fast bullet cannot step over one. */
+struct BulletPaths {
+    std::vector<float> x;               // midpoint
+    std::vector<float> y;
+    std::vector<float> half_dx;         // half the leg, midpoint to end
+    std::vector<float> half_dy;
+    std::vector<float> radius;
+
+    void clear ();
+    void add (float x0, float y0, float x1, float y1, float radius);
+    void append (const BulletPaths& more);
+    int size () const { return (int)x.size(); }
+};
+
+/* Broadphase for the brick/bullet test - bricks are filed under the cell holding
+   their centre and each bullet looks only at the cells its reach covers. Rebuilt
+   every tick as a counting sort, with no allocation once the vectors have grown.
+   Anything outside the grid is clamped to the edge cells, which keeps the answer
+   right and only costs speed out there. */
+struct BrickGrid {
+    float x_min, y_min, cell_size;
+    int columns, rows;
+    float reach_x, reach_y;         // largest brick half extents in the last build
+    std::vector<int> cell_start;    // columns*rows+1 offsets into items
+    std::vector<int> items;         // live brick slots, grouped by cell
+    // Centres and half extents copied in items order, so a query scans them contiguously
+    std::vector<float> item_x;
+    std::vector<float> item_y;
+    std::vector<float> item_half_width;
+    std::vector<float> item_half_length;
+    std::vector<unsigned char> item_hit;
+    std::vector<int> brick_cell;    // cell of each slot during build
+    std::vector<unsigned char> hit; // per slot, so a brick two bullets touch is reported once
+
+    void init (float x_min, float y_min, float x_max, float y_max, float cell_size);
+    int column (float x) const;
+    int row (float y) const;
+    void build (const BrickPool& bricks);
+};
+
+/* Below this many live brick x bullet pairs the brute force scan beats building
+   the grid - see bench/broadphase_bench */
+#define BROADPHASE_MIN_PAIRS 4096
+
+/* Work split across the job threads (see jobs.h) only past these sizes - below
+   them handing it out costs more than it saves */
+#define BULLET_JOB_SIZE 4096            // bullets per moveBullets job
+#define BASKET_JOB_MIN_BRICKS 8192      // bricks the basket checks look at, all told
+#define GRID_JOB_MIN_PAIRS 65536        // live brick x leg pairs before the grid query is split
+
+/* Live bricks any bullet path passes over, in live.dense order without repeats.
+   Both give the same answer; checkBrickBulletCollision picks one by pair count. */
+void findBrickHits (const BrickPool& bricks, const BulletPaths& paths, std::vector<int>& hits);
+void findBrickHitsGrid (BrickGrid& grid, const BrickPool& bricks, const BulletPaths& paths, std::vector<int>& hits);
+
+/* Swept circle against a mirror - a segment from (cx,cy) half_width along the unit
+   vector (ux,uy) each way, thickened to a capsule of radius reach. The circle starts
+   at (x,y) and moves along the unit vector (dx,dy). Returns the distance travelled at
+   first contact, or -1 if there is none within max_t, and the surface normal at the
+   contact in (nx,ny). Contact only counts while moving into the surface, so a bullet
+   leaving a mirror it has just bounced off is not caught again. */
+float sweepCircleCapsule (float x, float y, float dx, float dy, float max_t,
+                          float cx, float cy, float ux, float uy, float half_width, float reach,
+                          float& nx, float& ny);
+
+/* Does a circle of radius r moving from (x0,y0) to (x1,y1) overlap the box of half
+   extents hw, hh around (cx,cy) - the box grown by r against the segment, tested on
+   the x, y and segment-normal axes */
+bool sweptCircleHitsBox (float x0, float y0, float x1, float y1, float r,
+                         float cx, float cy, float hw, float hh);
+
+/* PCG32 - each Game draws from its own, so the same seed plays the same game */
+struct Rng {
+    uint64_t state;
+    uint64_t inc;
+
+    void seed (uint64_t seed);
+    uint32_t next ();
+    float uniform (float min, float max);   // in [min, max)
+    int below (int n);                      // in [0, n)
+};
+
+/* Everything that changes while playing except the pools - plain data, so
+   snapshots copy it in one go */
+struct GameState {
+    Laser laser;
+    Basket baskets[2];
+    Mirror mirrors[MAX_MIRRORS];
+
+    int total_score, game_over, total_mirrors, total_time;
+    float bricks_speed, bullet_speed, mirror_rotate_speed, mirror_trans_speed_1, mirror_trans_speed_2;
+    bool level1, level2, level3, mirror_up_1, mirror_up_2;
+
+    // Spawns, mirror moves and brick colors all come from here
+    uint64_t seed;
+    Rng rng;
+
+    // Ticks stepped so far, the spawn and cooldown timers run off this
+    uint32_t ticks, last_brick_tick, last_bullet_tick, last_clock_tick, last_mirror_tick;
+};
+
+struct Game : GameState {
+    BrickPool bricks;
+    BulletPool bullets;
+
+    // Scratch for moveBullets and checkBrickBulletCollision, kept here so the vectors are reused
+    BulletPaths bullet_paths;
+    std::vector<BulletPaths> bullet_path_jobs;  // legs of each moveBullets job past the first
+    std::vector<unsigned char> mirror_near;
+    BrickGrid brick_grid;
+    std::vector<int> brick_hits;
+    std::vector<int> basket_finds[2*2];         // caught and black bricks in each basket
+    std::vector<int> bullets_out;
+};
+
+/* What the player did since the last step. cursor_x/y persist, the rest are
+   presses to apply once - clearInputs resets them after a step has seen them */
+struct Inputs {
+    float cursor_x, cursor_y;  // mouse in world coordinates
+    int shoot;
+    int select_basket;         // right click: pick up the basket under the cursor or drop it
+    int laser_move;            // +up / -down
+    int stick_move;            // +up / -down
+    int basket_move[2];        // +right / -left
+    int speed_change;          // +faster / -slower
+};
+
+void initGame (Game& game, uint64_t seed = 1);
+void clearInputs (Inputs& inputs);
+
+/* Advance the game one tick of dt seconds - movement scales with dt, timers
+   count ticks, and the frontend always passes SIM_TICK */
+void step (Game& game, float dt, const Inputs& inputs);
+
+/* Same rules step() applies, exposed for tools that drive the game directly */
+void createBrick (Game& game);
+void shootBullet (Game& game);
+void checkBrickYLimit (Game& game);
+void checkRedBasket (Game& game);
+void checkGreenBasket (Game& game);
+void checkBrickBulletCollision (Game& game);
+void moveBullets (Game& game, float k);
+void checkBulletOutOfWindow (Game& game);
+void checkLevel (Game& game);
+
+/* Fingerprint of the state a replay or a peer should agree on - positions,
+   score, clock and rng, not the scratch or the previous tick */
+uint64_t hashGame (const Game& game);
+
+#endif
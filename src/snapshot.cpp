@@ -0,0 +1,63 @@
+#include <type_traits>
+
+#include "snapshot.h"
+
+using namespace std;
+
+static_assert(is_trivially_copyable<GameState>::value, "GameState has to stay plain data for snapshots");
+
+/*************
+ * Snapshots *
+ *************/
+
+void GameSnapshot::init () {
+  this->bricks.init(0);
+  this->bullets.init(0);
+}
+
+void GameSnapshot::save (const Game& game) {
+  this->state = game;
+  this->bricks.copyFrom(game.bricks);
+  this->bullets.copyFrom(game.bullets);
+}
+
+void GameSnapshot::restore (Game& game) const {
+  (GameState&)game = this->state;
+  game.bricks.copyFrom(this->bricks);
+  game.bullets.copyFrom(this->bullets);
+}
+
+/********
+ * Ring *
+ ********/
+
+void SnapshotRing::init (int size) {
+  this->snapshots.resize(size);
+  for(int i=0;i<size;i++)
+    this->snapshots[i].init();
+  this->newest = 0;
+  this->stored = 0;
+}
+
+void SnapshotRing::save (const Game& game) {
+  int size = (int)this->snapshots.size();
+  if(this->stored>0 && game.ticks==this->newest+1)
+    this->stored = min(this->stored+1, size);
+  else
+    this->stored = 1;
+  this->newest = game.ticks;
+  this->snapshots[game.ticks%size].save(game);
+}
+
+bool SnapshotRing::has (uint32_t tick) const {
+  return this->stored>0 && tick<=this->newest && this->newest-tick<(uint32_t)this->stored;
+}
+
+bool SnapshotRing::restore (uint32_t tick, Game& game) {
+  if(!this->has(tick))
+    return false;
+  this->snapshots[tick%this->snapshots.size()].restore(game);
+  this->stored -= this->newest-tick;
+  this->newest = tick;
+  return true;
+}
@@ -0,0 +1,39 @@
+#ifndef CRAZYBRICKS_SNAPSHOT_H
+#define CRAZYBRICKS_SNAPSHOT_H
+
+/* Copies of a Game to go back to, for rewind, restarts and rollback netplay.
+   The GameState part is plain data and goes across in one copy, the pools
+   copy only the slots in use, so a save or restore costs a few microseconds
+   at the sizes the game reaches and does not allocate once warmed up. The
+   scratch a Game keeps is rebuilt every tick and is not saved. */
+
+#include <stdint.h>
+#include <vector>
+
+#include "sim.h"
+
+struct GameSnapshot {
+    GameState state;
+    BrickPool bricks;
+    BulletPool bullets;
+
+    void init ();
+    void save (const Game& game);
+    void restore (Game& game) const;
+};
+
+/* The last size consecutive ticks, looked up by tick number */
+struct SnapshotRing {
+    std::vector<GameSnapshot> snapshots;
+    uint32_t newest;                    // tick of the latest save
+    int stored;                         // ticks kept, newest back
+
+    void init (int size);
+    // After each step - a tick that does not follow newest starts the ring over
+    void save (const Game& game);
+    bool has (uint32_t tick) const;
+    // game back to tick, dropping the ticks after it - false if tick is not kept
+    bool restore (uint32_t tick, Game& game);
+};
+
+#endif
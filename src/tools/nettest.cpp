@@ -0,0 +1,135 @@
+/* Both netplay peers in one process over 127.0.0.1, driven by scripted
+   inputs through the latency shim at 60 ticks a second. When both have
+   confirmed the same tick, their games have to match each other and a game
+   played straight through with the inputs they exchanged.
+   Build with `make nettest`, run as ./tools/nettest [--ticks n] [--delay n]
+   [--latency ms] [--jitter ms] [--loss percent] [--port n] [--seed n] */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "netplay.h"
+
+using namespace std;
+
+/* Something different every tick - player 0 waves the mouse and shoots, player 1 moves the basket */
+static void scriptInputs (Rng& rng, int player, Inputs& inputs) {
+  clearInputs(inputs);
+  if(player==0) {
+    if(rng.below(8)==0) {
+      inputs.cursor_x = rng.uniform(-4, 4);
+      inputs.cursor_y = rng.uniform(-4, 4);
+    }
+    inputs.shoot = rng.below(10)==0;
+    inputs.laser_move = rng.below(40)==0 ? (rng.below(2) ? 1 : -1) : 0;
+    inputs.select_basket = rng.below(300)==0;
+  }
+  else
+    inputs.basket_move[rng.below(2)] = rng.below(6)==0 ? (rng.below(2) ? 1 : -1) : 0;
+}
+
+int main (int argc, char** argv) {
+  int ticks = 1200, delay = NET_DEFAULT_INPUT_DELAY, port = 47810, p, i;
+  double latency = 40, jitter = 20;
+  float loss = 5;
+  uint64_t seed = 1;
+  Netplay peers[2];
+  Game games[2], reference;
+  Inputs inputs[2];
+  Rng scripts[2];
+
+  for(i=1;i+1<argc;i++) {
+    if(!strcmp(argv[i], "--ticks"))
+      ticks = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--delay"))
+      delay = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--latency"))
+      latency = atof(argv[++i]);
+    else if(!strcmp(argv[i], "--jitter"))
+      jitter = atof(argv[++i]);
+    else if(!strcmp(argv[i], "--loss"))
+      loss = atof(argv[++i]);
+    else if(!strcmp(argv[i], "--port"))
+      port = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--seed"))
+      seed = strtoull(argv[++i], NULL, 10);
+  }
+
+  for(p=0;p<2;p++) {
+    string peer = "127.0.0.1:"+to_string(port+1-p);
+    if(!peers[p].open(p, port+p, peer.c_str(), delay))
+      return 1;
+    peers[p].setShim(latency, jitter, loss, 100+p);
+    scripts[p].seed(seed*2+p);
+    clearInputs(inputs[p]);
+    inputs[p].cursor_x = inputs[p].cursor_y = 0;
+  }
+  // Netplay::connect() by hand for both at once - player 1 answers once it has player 0's seed
+  peers[0].seed = seed;
+  peers[1].seed = 0;
+  for(i=0;!peers[0].connected || !peers[1].connected;i++) {
+    if(i==500) {
+      fprintf(stderr, "no connection\n");
+      return 1;
+    }
+    for(p=0;p<2;p++) {
+      if(p==0 || peers[p].connected)
+        peers[p].send();
+      peers[p].receive();
+      peers[p].flush();
+    }
+    this_thread::sleep_for(chrono::milliseconds(10));
+  }
+  for(p=0;p<2;p++) {
+    initGame(games[p], peers[p].seed);
+    peers[p].start(games[p]);
+  }
+
+  // Real time, so the shim's delays mean what they say
+  chrono::steady_clock::time_point next = chrono::steady_clock::now();
+  double timeout = ticks*SIM_TICK*4+10, start = chrono::duration<double>(next.time_since_epoch()).count();
+  uint32_t target = ticks;
+  while(true) {
+    for(p=0;p<2;p++)
+      if(peers[p].advance(inputs[p]))
+        scriptInputs(scripts[p], p, inputs[p]);
+    // Stop where both are sure of the same tick
+    uint32_t sure = min(peers[0].confirmedTick(), peers[1].confirmedTick());
+    if(games[0].game_over && games[1].game_over && peers[0].confirmed() && peers[1].confirmed())
+      target = min(target, min(games[0].ticks, games[1].ticks));
+    if(sure>=target)
+      break;
+    next += chrono::microseconds((long)(SIM_TICK*1e6));
+    this_thread::sleep_until(next);
+    if(chrono::duration<double>(next.time_since_epoch()).count()-start>timeout) {
+      fprintf(stderr, "stuck at ticks %u/%u, confirmed %u/%u\n", games[0].ticks, games[1].ticks,
+        peers[0].confirmedTick(), peers[1].confirmedTick());
+      return 1;
+    }
+  }
+
+  // The same game without the network, from the inputs each player actually sent
+  initGame(reference, seed);
+  for(uint32_t t=0;t<target;t++) {
+    Inputs merged;
+    mergeInputs(peers[0].inputs[0][t], peers[1].inputs[1][t], merged);
+    step(reference, SIM_TICK, merged);
+  }
+  uint64_t hash = hashGame(reference);
+
+  bool ok = true;
+  for(p=0;p<2;p++) {
+    Netplay& n = peers[p];
+    printf("player %d: tick %u, %u rollbacks, %u ticks played again, %u stalls, %u desyncs, hash at %u %016llx\n",
+      p, games[p].ticks, n.rollbacks, n.resimulated, n.stalls, n.desyncs, target, (unsigned long long)n.hashes[target]);
+    ok = ok && n.hashes[target]==hash && !n.desyncs;
+    n.close();
+  }
+  printf("reference: hash at %u %016llx, score %d - %s\n", target, (unsigned long long)hash, reference.total_score,
+    ok ? "match" : "MISMATCH");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+/* Plays a session recorded with `sample2D --record path` back without a window,
+   as fast as step() goes, and prints where it ended - the same log always ends
+   on the same hash, so a change that alters the rules shows up here.
+   --rollback n goes back n ticks every n ticks and plays them again from the
+   snapshot ring, which has to end on the same hash as playing straight through.
+   --threads n steps on that many job threads, which must not change the hash either.
+   Build with `make replay`, run as ./tools/replay [--runs n] [--rollback n] [--threads n] path */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <vector>
+
+#include "inputlog.h"
+#include "jobs.h"
+#include "snapshot.h"
+
+using namespace std;
+
+static double now () {
+  return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main (int argc, char** argv) {
+  const char* path = NULL;
+  int runs = 1, rollback = 0, r, i;
+  InputPlayer player;
+  Game game;
+  Inputs inputs;
+  uint64_t hash = 0, straight_hash = 0;
+  SnapshotRing ring;
+  vector<Inputs> history;     // by tick, for playing rolled back ticks again
+  uint32_t rolled_back = 0;
+
+  for(i=1;i<argc;i++) {
+    if(!strcmp(argv[i], "--runs") && i+1<argc)
+      runs = max(1, atoi(argv[++i]));
+    else if(!strcmp(argv[i], "--rollback") && i+1<argc)
+      rollback = max(0, atoi(argv[++i]));
+    else if(!strcmp(argv[i], "--threads") && i+1<argc)
+      setJobThreads(atoi(argv[++i]));
+    else
+      path = argv[i];
+  }
+  if(!path) {
+    fprintf(stderr, "usage: %s [--runs n] [--rollback n] [--threads n] path\n", argv[0]);
+    return 2;
+  }
+  if(!player.load(path)) {
+    fprintf(stderr, "%s: not an input log\n", path);
+    return 1;
+  }
+
+  // Once straight through, untimed, for the rolled back runs to end up at
+  if(rollback) {
+    ring.init(rollback+1);
+    player.rewind();
+    initGame(game, player.seed);
+    while(!game.game_over && player.next(game.ticks, inputs))
+      step(game, SIM_TICK, inputs);
+    straight_hash = hashGame(game);
+  }
+
+  double t = now();
+  for(r=0;r<runs;r++) {
+    player.rewind();
+    initGame(game, player.seed);
+    history.clear();
+    if(rollback)
+      ring.save(game);
+    while(!game.game_over && player.next(game.ticks, inputs)) {
+      step(game, SIM_TICK, inputs);
+      if(!rollback)
+        continue;
+      history.push_back(inputs);
+      ring.save(game);
+      if(game.ticks%rollback==0 && ring.has(game.ticks-rollback)) {
+        uint32_t end = game.ticks;
+        ring.restore(end-rollback, game);
+        while(!game.game_over && game.ticks<end) {
+          step(game, SIM_TICK, history[game.ticks]);
+          ring.save(game);
+        }
+        rolled_back += rollback;
+      }
+    }
+    // Every run has to land on the same state
+    uint64_t run_hash = hashGame(game);
+    if(r > 0 && run_hash != hash) {
+      fprintf(stderr, "run %d ended on %016llx, run 0 on %016llx\n", r, (unsigned long long)run_hash, (unsigned long long)hash);
+      return 1;
+    }
+    if(rollback && run_hash != straight_hash) {
+      fprintf(stderr, "run %d with rollbacks ended on %016llx, straight through on %016llx\n", r,
+        (unsigned long long)run_hash, (unsigned long long)straight_hash);
+      return 1;
+    }
+    hash = run_hash;
+  }
+  t = now()-t;
+
+  printf("seed %llu, %u ticks, %d runs in %.3fs, %.0f ticks/s\n", (unsigned long long)player.seed,
+    game.ticks, runs, t, (double)game.ticks*runs/t);
+  if(rollback)
+    printf("%u ticks played again after rollbacks\n", rolled_back);
+  printf("score %d, time %d, bricks %d, bullets %d, hash %016llx\n", game.total_score, game.total_time,
+    game.bricks.alive(), game.bullets.alive(), (unsigned long long)hash);
+  return 0;
+}